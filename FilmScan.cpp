@@ -45,6 +45,7 @@
 #include <cmath>
 #include <cstring>
 #include <vector>
+#include <algorithm>
 
 //#include <boost/numeric/ublas/matrix.hpp>
 
@@ -91,10 +92,13 @@
 #include "readframedpx.h"
 #include "readframeexr.h"
 #include "readframetiff.h"
+#include "lightness.h"
 #include "wav.h"
 #include "aeoexception.h"
 
 #include "FilmScan.h"
+#include "framecache.h"
+#include "stripcache.h"
 
 #ifdef Q_OS_WIN32
 #define isslash(c) (((c)=='/')||((c)=='\\'))
@@ -262,6 +266,50 @@ unsigned char *Video::GetFrameImage(size_t frameNum, unsigned char *buf,
 
 	return buf;
 }
+
+// GetFrameImage() reduced to HSL lightness, (max+min)/2, as it is unpacked
+uint16_t *Video::GetFrameLightness(size_t frameNum, uint16_t *buf,
+		int &width,int &height)
+{
+	if(buf == NULL)
+	{
+		buf = new uint16_t [this->codec->width * this->codec->height];
+		if(buf == NULL)
+		{
+			throw AeoException("Out of Memory: video buf");
+		}
+	}
+
+	if(this->ReadFrame(frameNum) == false)
+	{
+		throw AeoException(
+				QString("Could not read requested frame number: %1").
+					arg(frameNum));
+	}
+
+	sws_scale(this->convertRGB,
+			(uint8_t const * const *)this->frameNative->data,
+			this->frameNative->linesize, 0, this->codec->height,
+			this->frameRGB->data, this->frameRGB->linesize);
+
+	width = this->codec->width;
+	height = this->codec->height;
+
+	uint16_t *out = buf;
+	for(int y=0; y<height; ++y)
+	{
+		const uint16_t *p = reinterpret_cast<const uint16_t *>(
+				this->frameRGB->data[0] + y*this->frameRGB->linesize[0]);
+		for(int x=0; x<width; ++x, p+=4)
+		{
+			uint32_t mx = std::max(p[0], std::max(p[1], p[2]));
+			uint32_t mn = std::min(p[0], std::min(p[1], p[2]));
+			*(out++) = uint16_t((mx + mn + 1) >> 1);
+		}
+	}
+
+	return buf;
+}
 #endif
 
 //-----------------------------------------------------------------------------
@@ -360,6 +408,7 @@ void FilmScan::Reset()
 	if(name) { delete [] name; name = NULL; }
 	if(path) { delete [] path; path = NULL; }
 	if(fnbuf) { delete [] fnbuf; fnbuf = NULL; }
+	if(rgbFrame) { delete rgbFrame; rgbFrame = NULL; }
 	srcFormat = SOURCE_UNKNOWN;
 	firstFrame = 0;
 	numFrames = 0;
@@ -1015,6 +1064,7 @@ FilmScan::~FilmScan()
 	if(this->name) delete [] this->name;
 	if(this->path) delete [] this->path;
 	if(this->fnbuf) delete [] this->fnbuf;
+	if(this->rgbFrame) delete this->rgbFrame;
 	#ifdef USELIBAV
 	if(this->vid) delete this->vid;
 	#endif
@@ -1079,6 +1129,26 @@ double* FilmScan::GetFrame(long frameNum, double *buf) const
 
 //-----------------------------------------------------------------------------
 
+// Reduce a decoded frame to one 16-bit plane of HSL lightness, (max+min)/2,
+// rounded the same way as the CPU engine's fixed point unpack.
+
+static void FrameLightness(const FrameTexture *src, uint16_t *out)
+{
+	PixelLightness(src->buf, size_t(src->width) * src->height, src->format,
+			src->nComponents, src->isNonNativeEndianess, out);
+}
+
+//-----------------------------------------------------------------------------
+// With SetLumaOnly() frames come back as one native 16-bit lightness channel
+// (GL_UNSIGNED_SHORT, nComponents 1), a third of the size of a colour scan
+// to upload and filter. The extraction only uses lightness anyway.
+//
+// With SetFrameCache() frames are looked up in the cache first, and with
+// fill set the ones that had to be decoded are added to it.
+//
+// With SetStripCache() lightness frames the strip holds are read from it
+// instead of the source.
+
 FrameTexture* FilmScan::GetFrameImage(long frameNum, FrameTexture *frame) const
 {
 	if(frameNum < this->FirstFrame() || frameNum > this->LastFrame())
@@ -1088,6 +1158,149 @@ FrameTexture* FilmScan::GetFrameImage(long frameNum, FrameTexture *frame) const
 
 	if(!frame) frame = new FrameTexture;
 
+	if(cache)
+	{
+		std::string source = CacheKey();
+		if(cache->Get(source, frameNum, frame)) return frame;
+
+		if(cacheFill)
+		{
+			// frame->buf may be write-only GL memory: decode into memory
+			// the cache can keep and copy from there
+			FrameTexture *decoded = new FrameTexture;
+			try
+			{
+				ReadFrameImage(frameNum, decoded);
+			}
+			catch(...)
+			{
+				delete decoded;
+				throw;
+			}
+			cache->Put(source, frameNum, decoded);
+			if(cache->Get(source, frameNum, frame)) return frame;
+		}
+	}
+
+	ReadFrameImage(frameNum, frame);
+	return frame;
+}
+
+void FilmScan::CacheFrame(long frameNum) const
+{
+	if(!cache || frameNum < FirstFrame() || frameNum > LastFrame()) return;
+
+	std::string source = CacheKey();
+	if(cache->Contains(source, frameNum)) return;
+
+	FrameTexture *decoded = new FrameTexture;
+	try
+	{
+		ReadFrameImage(frameNum, decoded);
+	}
+	catch(...)
+	{
+		delete decoded;
+		throw;
+	}
+	cache->Put(source, frameNum, decoded);
+}
+
+// a lightness decode is a different image from the colour one, and one
+// read from the strip cache is black outside the strip
+std::string FilmScan::CacheKey(void) const
+{
+	if(!lumaOnly) return inputName;
+	return inputName + (strip ? "#luma#strip" : "#luma");
+}
+
+// A buffer passed in with bufSize set is only written if the image fits;
+// otherwise the decoders allocate a new one. The old one is deleted unless
+// it is borrowed, in which case its owner finds frame->buf changed.
+static void Reallocated(FrameTexture *frame, uint8_t *given)
+{
+	if(frame->buf == given) return;
+
+	if(given && !frame->borrowed) delete [] given;
+	frame->borrowed = false;
+	frame->bufSize = std::max(frame->bufSize, int(FrameCache::Bytes(frame)));
+}
+
+void FilmScan::ReadFrameImage(long frameNum, FrameTexture *frame) const
+{
+	uint8_t *given = frame->buf;
+
+	if(!lumaOnly)
+		DecodeFrameImage(frameNum, frame);
+	else
+		DecodeFrameLightness(frameNum, frame);
+
+	Reallocated(frame, given);
+}
+
+// the buffer of frame, or NULL if it is known to have no room for bytes
+static uint8_t *Room(const FrameTexture *frame, size_t bytes)
+{
+	if(frame->bufSize > 0 && size_t(frame->bufSize) < bytes) return NULL;
+	return frame->buf;
+}
+
+void FilmScan::DecodeFrameLightness(long frameNum, FrameTexture *frame) const
+{
+	if(strip && strip->Read(frameNum, frame)) return;
+
+	#ifdef USELIBAV
+	if(this->srcFormat == SOURCE_LIBAV && this->vid)
+	{
+		frame->buf = reinterpret_cast<uint8_t *>(this->vid->GetFrameLightness(
+				frameNum, reinterpret_cast<uint16_t *>(
+					Room(frame, size_t(this->width) * this->height * 2)),
+				frame->width, frame->height));
+	}
+	else
+	#endif
+	if(this->srcFormat == SOURCE_DPX)
+	{
+		// the readers reduce each scanline as it is read
+		sprintf(this->fnbuf+strlen(this->path)+1, this->name, frameNum);
+		frame->buf = ReadFrameDPX_ImageData(fnbuf, frame->buf, frame->bufSize,
+				frame->width, frame->height, frame->isNonNativeEndianess,
+				frame->format, frame->nComponents, true);
+	}
+	else if(this->srcFormat == SOURCE_TIFF)
+	{
+		sprintf(this->fnbuf+strlen(this->path)+1, this->name, frameNum);
+		frame->buf = ReadFrameTIFF_ImageData(fnbuf, frame->buf,
+				frame->bufSize, frame->width, frame->height,
+				frame->isNonNativeEndianess, frame->format,
+				frame->nComponents, true);
+	}
+	else
+	{
+		// frame->buf may be write-only GL memory, so decode elsewhere
+		if(!rgbFrame) rgbFrame = new FrameTexture;
+		uint8_t *rgb = rgbFrame->buf;
+		DecodeFrameImage(frameNum, rgbFrame);
+		Reallocated(rgbFrame, rgb);
+
+		frame->width = rgbFrame->width;
+		frame->height = rgbFrame->height;
+		frame->buf = Room(frame, size_t(frame->width) * frame->height * 2);
+		if(frame->buf == NULL)
+		{
+			frame->bufSize = frame->width * frame->height * 2;
+			frame->buf = new uint8_t [frame->bufSize];
+		}
+		FrameLightness(rgbFrame, reinterpret_cast<uint16_t *>(frame->buf));
+	}
+
+	frame->nComponents = 1;
+	frame->format = GL_UNSIGNED_SHORT;
+	frame->isNonNativeEndianess = false;
+}
+
+void FilmScan::DecodeFrameImage(long frameNum, FrameTexture *frame) const
+{
 	switch(this->srcFormat)
 	{
 	case SOURCE_DPX:
@@ -1099,13 +1312,15 @@ FrameTexture* FilmScan::GetFrameImage(long frameNum, FrameTexture *frame) const
 	case SOURCE_TIFF:
 		sprintf(this->fnbuf+strlen(this->path)+1, this->name, frameNum);
 		frame->buf = ReadFrameTIFF_ImageData(fnbuf, frame->buf,
-				frame->width, frame->height, frame->isNonNativeEndianess,
-				frame->format, frame->nComponents);
+				frame->bufSize, frame->width, frame->height,
+				frame->isNonNativeEndianess, frame->format,
+				frame->nComponents);
 		break;
 	case SOURCE_LIBAV:
 		if(this->vid)
 		{
-			frame->buf = this->vid->GetFrameImage(frameNum, frame->buf,
+			frame->buf = this->vid->GetFrameImage(frameNum,
+					Room(frame, size_t(this->width) * this->height * 8),
 					frame->width, frame->height, frame->isNonNativeEndianess);
 			frame->nComponents = 4;
 			frame->format = GL_UNSIGNED_SHORT;
@@ -1115,7 +1330,8 @@ FrameTexture* FilmScan::GetFrameImage(long frameNum, FrameTexture *frame) const
 	case SOURCE_WAV:
 		if(this->synth)
 		{
-			frame->buf = this->synth->GetFrameImage(frameNum, frame->buf,
+			frame->buf = this->synth->GetFrameImage(frameNum,
+					Room(frame, size_t(this->width) * this->height * 8),
 					frame->width, frame->height, frame->isNonNativeEndianess);
 			frame->nComponents = 4;
 			frame->format = GL_UNSIGNED_SHORT;
@@ -1124,8 +1340,6 @@ FrameTexture* FilmScan::GetFrameImage(long frameNum, FrameTexture *frame) const
 	default:
 		throw AeoException("Internal scan format not set correctly");
 	}
-
-	return frame;
 }
 
 //-----------------------------------------------------------------------------
@@ -114,6 +114,8 @@ public:
 
 	unsigned char *GetFrameImage(size_t frameNum, unsigned char *buf,
 			int &width,int &height,bool &endian);
+	uint16_t *GetFrameLightness(size_t frameNum, uint16_t *buf,
+			int &width,int &height);
 };
 #endif
 
@@ -127,6 +129,9 @@ typedef int SourceFormat;
 #define SOURCE_WAV 5
 #define SOURCE_UNKNOWN 6
 
+class FrameCache;
+class StripCache;
+
 class FilmScan {
 private:
 	char *name;
@@ -143,8 +148,23 @@ private:
 #endif
 	wav *synth = NULL;
 
+	// decode scans to a single 16-bit lightness plane
+	bool lumaOnly = false;
+	mutable FrameTexture *rgbFrame = NULL; // lumaOnly colour decode of a synth
+
+	// decoded frames to reuse; cacheFill adds the frames decoded here
+	FrameCache *cache = NULL;
+	bool cacheFill = true;
+
+	// local copy of the columns the extraction reads, for lightness
+	StripCache *strip = NULL;
+
 	std::string inputName;
 
+	void DecodeFrameImage(long frameNum, FrameTexture *frame) const;
+	void DecodeFrameLightness(long frameNum, FrameTexture *frame) const;
+	void ReadFrameImage(long frameNum, FrameTexture *frame) const;
+
 public:
 	QString TimeCode;
 
@@ -185,6 +205,10 @@ public:
 
 	double *GetFrame(long frameNum, double *buf) const;
 	FrameTexture *GetFrameImage(long frameNum, FrameTexture *frame) const;
+	// decode the frame into the frame cache unless it is there already
+	void CacheFrame(long frameNum) const;
+	// identifies the decoded images, in the frame and stage caches
+	std::string CacheKey(void) const;
 	FilmFrame GetFrame(long frameNum) const;
 	FilmStrip GetFrameRange(long frameRange[2]) const;
 
@@ -195,6 +219,15 @@ public:
 		unsigned int r) const;
 
 	bool IsSynth(void) const { return (synth != NULL); };
+
+	void SetLumaOnly(bool on) { lumaOnly = on; };
+	bool IsLumaOnly(void) const { return lumaOnly; };
+	void SetFrameCache(FrameCache *c, bool fill = true)
+		{ cache = c; cacheFill = fill; };
+	FrameCache *GetFrameCache(void) const { return cache; };
+	bool FillsFrameCache(void) const { return cacheFill; };
+	void SetStripCache(StripCache *s) { strip = s; };
+	StripCache *GetStripCache(void) const { return strip; };
 	int SynthOverlap(void) const { return (synth? synth->GetOverlap() : 0); };
 };
 
@@ -42,6 +42,8 @@ QT       += core gui multimedia xml
 win32: QT += opengl
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+# Qt 6 moved the versioned GL functions and timer queries out of QtGui
+greaterThan(QT_MAJOR_VERSION, 5): QT += opengl
 
 TARGET = AEO-Light
 TEMPLATE = app
@@ -109,7 +111,20 @@ SOURCES += \
     preferencesdialog.cpp \
     extractdialog.cpp \
     metadata.cpp \
-    videoencoder.cpp
+    videoencoder.cpp \
+    overlapsearch.cpp \
+    cpuengine.cpp \
+    tonecurve.cpp \
+    extractionbackend.cpp \
+    extractionworker.cpp \
+    frameloader.cpp \
+    framecache.cpp \
+    samplestream.cpp \
+    frameprefetcher.cpp \
+    stagecache.cpp \
+    stripcache.cpp \
+    overlapmap.cpp \
+    lightness.cpp
 
 HEADERS  += mainwindow.h \
     FilmScan.h \
@@ -129,7 +144,20 @@ HEADERS  += mainwindow.h \
     preferencesdialog.h \
     extractdialog.h \
     metadata.h \
-    videoencoder.h
+    videoencoder.h \
+    overlapsearch.h \
+    cpuengine.h \
+    tonecurve.h \
+    extractionbackend.h \
+    extractionworker.h \
+    frameloader.h \
+    framecache.h \
+    samplestream.h \
+    frameprefetcher.h \
+    stagecache.h \
+    stripcache.h \
+    overlapmap.h \
+    lightness.h
 
 FORMS    += mainwindow.ui \
     savesampledialog.ui \
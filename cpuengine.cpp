@@ -0,0 +1,846 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "cpuengine.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "aeoexception.h"
+
+#define PI 3.14159265358979323846
+
+// vertical halo of the 5x5 kernels, which step two pixels per tap
+#define CPU_KERNEL_HALO 4
+#define CPU_RING_ROWS (2*CPU_KERNEL_HALO+1)
+
+// widest strip whose 16-bit row sums still fit in 32 bits
+#define CPU_FIXED_MAX_WIDTH 65536
+
+// The 5x5 Gaussian of render mode 0 is the outer product of this vector
+static const float GAUSS_5[5] = {
+	0.18034033397698215f, 0.2095255753595122f, 0.22026818132701143f,
+	0.2095255753595122f, 0.18034033397698215f };
+
+// GAUSS_5 in 16.16 fixed point, centre adjusted so the taps sum to one
+static const uint32_t GAUSS_5_Q16[5] = { 11819, 13731, 14436, 13731, 11819 };
+
+// scale of the blur mix and calibration factors in the fixed point path
+#define CPU_FACTOR_BITS 24
+
+// x / 2^bits rounded to nearest, for either sign
+static inline int64_t RoundShift(int64_t x, int bits)
+{
+	return (x + (int64_t(1) << (bits-1))) >> bits;
+}
+
+CpuEngine::CpuEngine()
+{
+	lift = 0;
+	gamma = 1.0;
+	gain = 1.0;
+	threshold = 0;
+	blur = 0;
+	stereo = 0;
+	fixed_point = false;
+	thresh = false;
+	negative = false;
+	cal_enabled = false;
+	is_calc = false;
+	track_pitch = false;
+	overlap_target = 2;
+	bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0;
+	overlap[0] = overlap[1] = overlap[2] = overlap[3] = 0;
+	pixbounds[0] = pixbounds[1] = 0;
+	rot_angle = 0;
+	samplesperframe = 2000;
+	samplesperframe_file = 2000;
+
+	input_w = 0;
+	input_h = 0;
+
+	bestmatch.postion = 0;
+	bestmatch.value = 0;
+	bestmatch.subsample = 0;
+	for(int i=0; i<5; ++i) match_array[i] = bestmatch;
+
+	stripStart = 0;
+	stripWidth = 0;
+	adjStart = 0;
+	adjEnd = 0;
+	pixStart = 0;
+	pixEnd = 0;
+}
+
+CpuEngine::~CpuEngine()
+{
+}
+
+//-----------------------------------------------------------------------------
+// Work out which columns of the frame the extraction reads: the sound
+// bounds plus the kernel halo, and the picture bounds used for overlap.
+
+void CpuEngine::SetStrip()
+{
+	int w = input_w;
+
+	// the shader adjusts fragments whose centre lies strictly inside
+	int a = int(std::floor(bounds[0]*w - 0.5)) + 1;
+	int b = int(std::ceil(bounds[1]*w - 0.5));
+	a = std::max(0, std::min(a, w));
+	b = std::max(a, std::min(b, w));
+
+	// picture columns whose centres fall inside the picture bounds
+	int pa = int(std::ceil(pixbounds[0]*w - 0.5));
+	int pb = int(std::ceil(pixbounds[1]*w - 0.5));
+	pa = std::max(0, std::min(pa, w-1));
+	pb = std::max(pa+1, std::min(pb, w));
+
+	int s0 = std::max(0, std::min(a - CPU_KERNEL_HALO, pa));
+	int s1 = std::min(w, std::max(b + CPU_KERNEL_HALO, pb));
+
+	stripStart = s0;
+	stripWidth = s1 - s0;
+	adjStart = a - s0;
+	adjEnd = b - s0;
+	if(adjEnd <= adjStart) adjStart = adjEnd = 0;
+	pixStart = pa - s0;
+	pixEnd = pb - s0;
+}
+
+//-----------------------------------------------------------------------------
+// Convert n pixels starting at column x0 of a row to HSL lightness,
+// (max+min)/2, in the 0-1 range the GL_RGB16 texture would hold.
+
+void CpuEngine::UnpackRow(const FrameTexture *frame, int row, int x0, int n,
+		float *out) const
+{
+	int nc = frame->nComponents;
+	int rgb = std::min(nc, 3);
+	int i, c;
+
+	switch(frame->format)
+	{
+	case GL_UNSIGNED_INT_10_10_10_2:
+	{
+		const uint32_t *p = reinterpret_cast<const uint32_t *>(frame->buf) +
+				size_t(row)*frame->width + x0;
+		for(i=0; i<n; ++i)
+		{
+			uint32_t v = p[i];
+			if(frame->isNonNativeEndianess)
+				v = (v>>24) | ((v>>8)&0xFF00) | ((v<<8)&0xFF0000) | (v<<24);
+			uint32_t r = (v>>22)&0x3FF, g = (v>>12)&0x3FF, bl = (v>>2)&0x3FF;
+			uint32_t mx = std::max(r, std::max(g, bl));
+			uint32_t mn = std::min(r, std::min(g, bl));
+			out[i] = float(mx + mn) * (0.5f/1023.0f);
+		}
+		break;
+	}
+	case GL_UNSIGNED_SHORT:
+	{
+		const uint16_t *p = reinterpret_cast<const uint16_t *>(frame->buf) +
+				(size_t(row)*frame->width + x0) * nc;
+		if(nc == 1 && !frame->isNonNativeEndianess) // lightness already
+		{
+			for(i=0; i<n; ++i)
+				out[i] = float(p[i]) * (1.0f/65535.0f);
+			break;
+		}
+		for(i=0; i<n; ++i, p+=nc)
+		{
+			uint16_t mx = 0, mn = 0xFFFF;
+			for(c=0; c<rgb; ++c)
+			{
+				uint16_t v = p[c];
+				if(frame->isNonNativeEndianess) v = uint16_t((v>>8) | (v<<8));
+				mx = std::max(mx, v);
+				mn = std::min(mn, v);
+			}
+			out[i] = float(int(mx) + int(mn)) * (0.5f/65535.0f);
+		}
+		break;
+	}
+	case GL_UNSIGNED_BYTE:
+	{
+		const uint8_t *p = frame->buf + (size_t(row)*frame->width + x0) * nc;
+		for(i=0; i<n; ++i, p+=nc)
+		{
+			uint8_t mx = 0, mn = 0xFF;
+			for(c=0; c<rgb; ++c)
+			{
+				mx = std::max(mx, p[c]);
+				mn = std::min(mn, p[c]);
+			}
+			out[i] = float(int(mx) + int(mn)) * (0.5f/255.0f);
+		}
+		break;
+	}
+	default:
+		throw AeoException("CPU engine: unsupported pixel format");
+	}
+}
+
+//-----------------------------------------------------------------------------
+// UnpackRow() for the fixed point path: lightness in 16-bit units, rounded
+// to nearest.
+
+void CpuEngine::UnpackRow16(const FrameTexture *frame, int row, int x0, int n,
+		uint16_t *out) const
+{
+	int nc = frame->nComponents;
+	int rgb = std::min(nc, 3);
+	int i, c;
+
+	switch(frame->format)
+	{
+	case GL_UNSIGNED_INT_10_10_10_2:
+	{
+		const uint32_t *p = reinterpret_cast<const uint32_t *>(frame->buf) +
+				size_t(row)*frame->width + x0;
+		for(i=0; i<n; ++i)
+		{
+			uint32_t v = p[i];
+			if(frame->isNonNativeEndianess)
+				v = (v>>24) | ((v>>8)&0xFF00) | ((v<<8)&0xFF0000) | (v<<24);
+			uint32_t r = (v>>22)&0x3FF, g = (v>>12)&0x3FF, bl = (v>>2)&0x3FF;
+			uint32_t mx = std::max(r, std::max(g, bl));
+			uint32_t mn = std::min(r, std::min(g, bl));
+			out[i] = uint16_t(((mx + mn) * 65535 + 1023) / 2046);
+		}
+		break;
+	}
+	case GL_UNSIGNED_SHORT:
+	{
+		const uint16_t *p = reinterpret_cast<const uint16_t *>(frame->buf) +
+				(size_t(row)*frame->width + x0) * nc;
+		if(nc == 1 && !frame->isNonNativeEndianess) // lightness already
+		{
+			memcpy(out, p, n*sizeof(uint16_t));
+			break;
+		}
+		for(i=0; i<n; ++i, p+=nc)
+		{
+			uint16_t mx = 0, mn = 0xFFFF;
+			for(c=0; c<rgb; ++c)
+			{
+				uint16_t v = p[c];
+				if(frame->isNonNativeEndianess) v = uint16_t((v>>8) | (v<<8));
+				mx = std::max(mx, v);
+				mn = std::min(mn, v);
+			}
+			out[i] = uint16_t((uint32_t(mx) + mn + 1) >> 1);
+		}
+		break;
+	}
+	case GL_UNSIGNED_BYTE:
+	{
+		const uint8_t *p = frame->buf + (size_t(row)*frame->width + x0) * nc;
+		for(i=0; i<n; ++i, p+=nc)
+		{
+			uint8_t mx = 0, mn = 0xFF;
+			for(c=0; c<rgb; ++c)
+			{
+				mx = std::max(mx, p[c]);
+				mn = std::min(mn, p[c]);
+			}
+			out[i] = uint16_t(((uint32_t(mx) + mn) * 257 + 1) >> 1);
+		}
+		break;
+	}
+	default:
+		throw AeoException("CPU engine: unsupported pixel format");
+	}
+}
+
+//-----------------------------------------------------------------------------
+// One row of the strip. Rotation is about the frame centre in texture
+// coordinates, as in render mode 0, with bilinear filtering and clamp to
+// edge; it needs the whole frame unpacked first.
+
+void CpuEngine::FetchRow(const FrameTexture *frame, int row, float *out)
+{
+	if(rotSource.empty())
+	{
+		UnpackRow(frame, row, stripStart, stripWidth, out);
+		return;
+	}
+
+	int w = input_w, h = input_h;
+	float angle = float(PI * rot_angle / 180.0);
+	float s = std::sin(angle);
+	float c = std::cos(angle);
+	float v = (row + 0.5f)/h - 0.5f;
+
+	for(int x=0; x<stripWidth; ++x)
+	{
+		float u = (stripStart + x + 0.5f)/w - 0.5f;
+		float fx = (c*u + s*v + 0.5f)*w - 0.5f;
+		float fy = (-s*u + c*v + 0.5f)*h - 0.5f;
+		fx = std::min(std::max(fx, 0.0f), float(w-1));
+		fy = std::min(std::max(fy, 0.0f), float(h-1));
+		int x0 = int(fx), y0 = int(fy);
+		int x1 = std::min(x0+1, w-1), y1 = std::min(y0+1, h-1);
+		float ax = fx - x0, ay = fy - y0;
+		const float *r0 = &rotSource[size_t(y0)*w];
+		const float *r1 = &rotSource[size_t(y1)*w];
+		out[x] = (r0[x0]*(1-ax) + r0[x1]*ax)*(1-ay) +
+				(r1[x0]*(1-ax) + r1[x1]*ax)*ay;
+	}
+}
+
+void CpuEngine::FetchRow16(const FrameTexture *frame, int row, uint16_t *out)
+{
+	if(rotSource.empty())
+	{
+		UnpackRow16(frame, row, stripStart, stripWidth, out);
+		return;
+	}
+
+	// resampling is done in float and rounded once
+	rowOut.resize(stripWidth);
+	FetchRow(frame, row, &rowOut[0]);
+	for(int x=0; x<stripWidth; ++x)
+	{
+		float v = std::min(std::max(rowOut[x], 0.0f), 1.0f);
+		out[x] = uint16_t(v*65535.0f + 0.5f);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Horizontal half of the blur and sharpen kernels for one row.
+//
+// The Gaussian is separable, so it runs as a horizontal and a vertical
+// 5-tap pass. The sharpen kernel is -1/8 over the 5x5 neighbourhood,
+// 1/4 over the inner 3x3 and 1 at the centre, which is
+// -1/8 box5 + 3/8 box3 + 3/4 centre with both boxes separable.
+// (The shader's tap 18 repeats the (+x,+y) offset instead of (+x,-y);
+// the symmetric kernel it was meant to be is used here.)
+// Taps are two pixels apart and clamp to the frame edge; the strip
+// holds the halo.
+
+void CpuEngine::FilterRow(const float *in, float *g, float *b5,
+		float *b3) const
+{
+	int w = stripWidth;
+
+	for(int x=0; x<adjEnd-adjStart; ++x)
+	{
+		int cx = adjStart + x;
+		float t0 = in[std::max(cx-4, 0)];
+		float t1 = in[std::max(cx-2, 0)];
+		float t2 = in[cx];
+		float t3 = in[std::min(cx+2, w-1)];
+		float t4 = in[std::min(cx+4, w-1)];
+
+		g[x] = GAUSS_5[0]*t0 + GAUSS_5[1]*t1 + GAUSS_5[2]*t2 +
+				GAUSS_5[3]*t3 + GAUSS_5[4]*t4;
+		b3[x] = t1 + t2 + t3;
+		b5[x] = t0 + b3[x] + t4;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// The fused kernel: every row is read once and leaves only its means.
+
+void CpuEngine::LoadFrame(const FrameTexture *frame)
+{
+	Prepare(frame);
+
+	std::swap(cur, prev);
+	if(fixed_point && stripWidth <= CPU_FIXED_MAX_WIDTH)
+		KernelFixed(frame, cur);
+	else
+		Kernel(frame, cur);
+
+	// a first frame has no predecessor; compare it with itself
+	if(prev.sound.size() != cur.sound.size())
+		prev = cur;
+}
+
+void CpuEngine::LoadRows(const RowMeans &rows)
+{
+	std::swap(cur, prev);
+	cur = rows;
+	input_h = int(rows.sound.size());
+
+	if(prev.sound.size() != cur.sound.size())
+		prev = cur;
+}
+
+void CpuEngine::Prepare(const FrameTexture *frame)
+{
+	if(!frame || !frame->buf)
+		throw AeoException("CPU engine: no frame image");
+
+	input_w = frame->width;
+	input_h = frame->height;
+
+	SetStrip();
+
+	// saturation has no effect on a single lightness channel
+	tone.Update(negative, lift, gamma, gain, thresh, threshold);
+
+	if(rot_angle != 0)
+	{
+		rotSource.resize(size_t(input_w) * input_h);
+		for(int y=0; y<input_h; ++y)
+			UnpackRow(frame, y, 0, input_w, &rotSource[size_t(y)*input_w]);
+	}
+	else rotSource.clear();
+}
+
+static void ResizeRows(CpuEngine::RowMeans &rows, int h)
+{
+	rows.sound.resize(h);
+	rows.left.resize(h);
+	rows.right.resize(h);
+	rows.pix.resize(h);
+}
+
+void CpuEngine::Kernel(const FrameTexture *frame, RowMeans &means)
+{
+	ResizeRows(means, input_h);
+
+	int w = stripWidth;
+	int aw = adjEnd - adjStart;
+	int mid = adjStart + aw/2;
+	bool filter = (blur != 0 && aw > 0);
+
+	ringLuma.resize(size_t(CPU_RING_ROWS) * w);
+	rowOut.resize(w);
+	if(filter)
+	{
+		ringGauss.resize(size_t(CPU_RING_ROWS) * aw);
+		ringBox5.resize(ringGauss.size());
+		ringBox3.resize(ringGauss.size());
+	}
+
+	int loaded = -1;
+
+	for(int y=0; y<input_h; ++y)
+	{
+		// bring in the rows the vertical taps of this row reach
+		int need = std::min(y + CPU_KERNEL_HALO, input_h-1);
+		while(loaded < need)
+		{
+			++loaded;
+			size_t slot = loaded % CPU_RING_ROWS;
+			float *luma = &ringLuma[slot*w];
+			FetchRow(frame, loaded, luma);
+			if(filter)
+				FilterRow(luma, &ringGauss[slot*aw], &ringBox5[slot*aw],
+						&ringBox3[slot*aw]);
+		}
+
+		const float *in = &ringLuma[size_t(y % CPU_RING_ROWS)*w];
+		float *out = &rowOut[0];
+		float cal = 1.0f;
+
+		if(cal_enabled && !calMask.empty())
+			cal = 0.5f / Calibration(y);
+
+		// outside the sound bounds the picture is not adjusted
+		std::copy(in, in+adjStart, out);
+		std::copy(in+adjEnd, in+w, out+adjEnd);
+
+		const float *g[5], *b5[5], *b3[5];
+		if(filter)
+		{
+			for(int t=0; t<5; ++t)
+			{
+				int r = std::min(std::max(y + 2*(t-2), 0), input_h-1);
+				size_t o = size_t(r % CPU_RING_ROWS) * aw;
+				g[t] = &ringGauss[o];
+				b5[t] = &ringBox5[o];
+				b3[t] = &ringBox3[o];
+			}
+		}
+
+		for(int x=0; x<aw; ++x)
+		{
+			float v = in[adjStart + x];
+
+			if(filter)
+			{
+				if(blur > 0)
+				{
+					float box5 = b5[0][x] + b5[1][x] + b5[2][x] +
+							b5[3][x] + b5[4][x];
+					float box3 = b3[1][x] + b3[2][x] + b3[3][x];
+					float sharp = -0.125f*box5 + 0.375f*box3 + 0.75f*v;
+					v += (sharp - v)*blur;
+				}
+				else
+				{
+					float gauss = GAUSS_5[0]*g[0][x] + GAUSS_5[1]*g[1][x] +
+							GAUSS_5[2]*g[2][x] + GAUSS_5[3]*g[3][x] +
+							GAUSS_5[4]*g[4][x];
+					v += (gauss - v)*(-2.0f*blur);
+				}
+			}
+
+			out[adjStart + x] = tone.Lookup(v * cal);
+		}
+
+		// reduce the row
+		double left = 0, right = 0, pix = 0;
+		int x;
+		for(x=adjStart; x<mid; ++x) left += out[x];
+		for(; x<adjEnd; ++x) right += out[x];
+		for(x=pixStart; x<pixEnd; ++x) pix += out[x];
+
+		means.sound[y] = aw ? float((left + right) / aw) : 0.0f;
+		means.left[y] = (mid > adjStart) ? float(left / (mid-adjStart)) :
+				means.sound[y];
+		means.right[y] = (adjEnd > mid) ? float(right / (adjEnd-mid)) :
+				means.sound[y];
+		means.pix[y] = float(pix / (pixEnd-pixStart));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Fixed point version of Kernel(). Samples stay 16-bit integers through
+// the filters, the blur mix, calibration and the tone table; row sums are
+// 32-bit and only the final mean is converted to float. Every step rounds
+// to nearest, which FixedPointBound() accounts for.
+
+void CpuEngine::KernelFixed(const FrameTexture *frame, RowMeans &means)
+{
+	ResizeRows(means, input_h);
+
+	int w = stripWidth;
+	int aw = adjEnd - adjStart;
+	int mid = adjStart + aw/2;
+	bool filter = (blur != 0 && aw > 0);
+	const uint16_t *lut = tone.Curve16();
+
+	const int64_t one = int64_t(1) << CPU_FACTOR_BITS;
+	int64_t mix = int64_t(std::fabs(blur < 0 ? -2.0*blur : blur) * one + 0.5);
+
+	ringLuma16.resize(size_t(CPU_RING_ROWS) * w);
+	rowOut16.resize(w);
+	if(filter)
+	{
+		ringGauss16.resize(size_t(CPU_RING_ROWS) * aw);
+		ringBox5i.resize(ringGauss16.size());
+		ringBox3i.resize(ringGauss16.size());
+	}
+
+	int loaded = -1;
+
+	for(int y=0; y<input_h; ++y)
+	{
+		int need = std::min(y + CPU_KERNEL_HALO, input_h-1);
+		while(loaded < need)
+		{
+			++loaded;
+			size_t slot = loaded % CPU_RING_ROWS;
+			uint16_t *luma = &ringLuma16[slot*w];
+			FetchRow16(frame, loaded, luma);
+			if(!filter) continue;
+
+			uint16_t *g = &ringGauss16[slot*aw];
+			int32_t *b5 = &ringBox5i[slot*aw];
+			int32_t *b3 = &ringBox3i[slot*aw];
+			for(int x=0; x<aw; ++x)
+			{
+				int cx = adjStart + x;
+				uint32_t t0 = luma[std::max(cx-4, 0)];
+				uint32_t t1 = luma[std::max(cx-2, 0)];
+				uint32_t t2 = luma[cx];
+				uint32_t t3 = luma[std::min(cx+2, w-1)];
+				uint32_t t4 = luma[std::min(cx+4, w-1)];
+
+				g[x] = uint16_t((GAUSS_5_Q16[0]*t0 + GAUSS_5_Q16[1]*t1 +
+						GAUSS_5_Q16[2]*t2 + GAUSS_5_Q16[3]*t3 +
+						GAUSS_5_Q16[4]*t4 + 32768) >> 16);
+				b3[x] = int32_t(t1 + t2 + t3);
+				b5[x] = int32_t(t0 + t4) + b3[x];
+			}
+		}
+
+		const uint16_t *in = &ringLuma16[size_t(y % CPU_RING_ROWS)*w];
+		uint16_t *out = &rowOut16[0];
+		int64_t cal = one;
+
+		if(cal_enabled && !calMask.empty())
+			cal = int64_t(0.5 / Calibration(y) * one + 0.5);
+
+		std::copy(in, in+adjStart, out);
+		std::copy(in+adjEnd, in+w, out+adjEnd);
+
+		const uint16_t *g[5];
+		const int32_t *b5[5], *b3[5];
+		if(filter)
+		{
+			for(int t=0; t<5; ++t)
+			{
+				int r = std::min(std::max(y + 2*(t-2), 0), input_h-1);
+				size_t o = size_t(r % CPU_RING_ROWS) * aw;
+				g[t] = &ringGauss16[o];
+				b5[t] = &ringBox5i[o];
+				b3[t] = &ringBox3i[o];
+			}
+		}
+
+		for(int x=0; x<aw; ++x)
+		{
+			int64_t v = in[adjStart + x];
+
+			if(filter)
+			{
+				int64_t target;
+				if(blur > 0)
+				{
+					int32_t box5 = b5[0][x] + b5[1][x] + b5[2][x] +
+							b5[3][x] + b5[4][x];
+					int32_t box3 = b3[1][x] + b3[2][x] + b3[3][x];
+					// -1/8 box5 + 3/8 box3 + 3/4 centre, in eighths
+					target = RoundShift(-box5 + 3*box3 + 6*int32_t(v), 3);
+				}
+				else
+				{
+					uint32_t gauss = GAUSS_5_Q16[0]*g[0][x] +
+							GAUSS_5_Q16[1]*g[1][x] + GAUSS_5_Q16[2]*g[2][x] +
+							GAUSS_5_Q16[3]*g[3][x] + GAUSS_5_Q16[4]*g[4][x];
+					target = (gauss + 32768) >> 16;
+				}
+				v += RoundShift((target - v) * mix, CPU_FACTOR_BITS);
+			}
+
+			v = RoundShift(v * cal, CPU_FACTOR_BITS);
+			v = std::min(std::max(v, int64_t(0)), int64_t(65535));
+
+			out[adjStart + x] = lut[v];
+		}
+
+		uint32_t left = 0, right = 0, pix = 0;
+		int x;
+		for(x=adjStart; x<mid; ++x) left += out[x];
+		for(; x<adjEnd; ++x) right += out[x];
+		for(x=pixStart; x<pixEnd; ++x) pix += out[x];
+
+		const float scale = 1.0f/65535.0f;
+		means.sound[y] = aw ? float(double(left) + right) / aw * scale : 0.0f;
+		means.left[y] = (mid > adjStart) ?
+				float(left) / (mid-adjStart) * scale : means.sound[y];
+		means.right[y] = (adjEnd > mid) ?
+				float(right) / (adjEnd-mid) * scale : means.sound[y];
+		means.pix[y] = float(pix) / (pixEnd-pixStart) * scale;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Error budget of KernelFixed() against Kernel(), in 16-bit steps. Each
+// rounding adds half a step; linear stages scale what comes in by the sum
+// of their absolute weights; the tone table scales it by its steepest
+// step. Means of rows cannot be further off than their samples.
+
+float CpuEngine::FixedPointBound() const
+{
+	double e = 0.5; // unpacking
+
+	if(blur != 0 && adjEnd > adjStart)
+	{
+		if(blur > 0)
+		{
+			// sharpen weights sum to 5 in absolute value
+			double sharp = 5.0*e + 0.5;
+			e = std::fabs(1.0-blur)*e + blur*sharp + 0.5;
+		}
+		else
+		{
+			// quantised Gaussian weights against the exact ones, per pass
+			double dw = 0;
+			for(int i=0; i<5; ++i)
+				dw += std::fabs(GAUSS_5_Q16[i]/65536.0 - GAUSS_5[i]);
+			double gauss = e + 2.0*(0.5*dw*65535.0 + 0.5);
+			double b = -2.0*blur;
+			e = std::fabs(1.0-b)*e + b*gauss + 0.5;
+		}
+	}
+
+	if(cal_enabled && !calMask.empty())
+	{
+		float maxGain = 0;
+		for(size_t i=0; i<calMask.size(); ++i)
+			maxGain = std::max(maxGain, 0.5f/calMask[i]);
+		e = e*maxGain + 0.5;
+	}
+	else e += 0.5;
+
+	// tone table lookup, then the table's own rounding
+	e = e * tone.MaxStep() * 65535.0 + 0.5;
+
+	// float rounding in the reference path
+	return float(e / 65535.0 + 1e-5);
+}
+
+float CpuEngine::VerifyFixedPoint(const FrameTexture *frame)
+{
+	RowMeans a, b;
+
+	Prepare(frame);
+	Kernel(frame, a);
+	KernelFixed(frame, b);
+
+	float worst = 0;
+	for(int y=0; y<input_h; ++y)
+	{
+		worst = std::max(worst, std::fabs(a.sound[y] - b.sound[y]));
+		worst = std::max(worst, std::fabs(a.left[y] - b.left[y]));
+		worst = std::max(worst, std::fabs(a.right[y] - b.right[y]));
+		worst = std::max(worst, std::fabs(a.pix[y] - b.pix[y]));
+	}
+
+	return worst;
+}
+
+//-----------------------------------------------------------------------------
+// The calibration mask is the cal_audio_texture column, bottom row first.
+
+void CpuEngine::SetCalibrationMask(const float *mask, int n)
+{
+	if(mask && n>0)
+		calMask.assign(mask, mask+n);
+	else
+		calMask.clear();
+}
+
+float CpuEngine::Calibration(int row) const
+{
+	int n = int(calMask.size());
+	float t = (1.0f - (row + 0.5f)/input_h) * n - 0.5f;
+	t = std::min(std::max(t, 0.0f), float(n-1));
+	int i0 = int(t);
+	int i1 = std::min(i0+1, n-1);
+	float a = t - i0;
+
+	return calMask[i0]*(1-a) + calMask[i1]*a;
+}
+
+//-----------------------------------------------------------------------------
+// Linear interpolation of a per-row array at texture coordinate y, with
+// clamp to edge, as a texture2D() lookup would return it.
+
+float CpuEngine::Sample(const std::vector<float> &rows, float y)
+{
+	int n = int(rows.size());
+	float t = y * n - 0.5f;
+	t = std::min(std::max(t, 0.0f), float(n-1));
+	int i0 = int(t);
+	int i1 = std::min(i0+1, n-1);
+	float a = t - i0;
+
+	return rows[i0]*(1-a) + rows[i1]*a;
+}
+
+void CpuEngine::OverlapProfiles(float *curOut, float *prevOut, int n) const
+{
+	// push-pull tracks are compared on their left half
+	const std::vector<float> &cs = (stereo == 2) ? cur.left : cur.sound;
+	const std::vector<float> &ps = (stereo == 2) ? prev.left : prev.sound;
+
+	for(int r=0; r<n; ++r)
+	{
+		float y = (r + 0.5f)/n;
+		float c = Sample(cs, y);
+		float p = Sample(ps, y);
+
+		if(overlap_target == 1)
+		{
+			c = Sample(cur.pix, y);
+			p = Sample(prev.pix, y);
+		}
+		else if(overlap_target == 2)
+		{
+			c = (c + Sample(cur.pix, y))/2;
+			p = (p + Sample(prev.pix, y))/2;
+		}
+
+		curOut[r] = c;
+		prevOut[r] = p;
+	}
+}
+
+void CpuEngine::FindOverlap()
+{
+	int n = samplesperframe;
+	int start, end;
+
+	profileCur.resize(n);
+	profilePrev.resize(n);
+	errors.resize(n);
+
+	OverlapProfiles(&profileCur[0], &profilePrev[0], n);
+	if(!track_pitch) search.ResetTracking();
+	search.Search(&profileCur[0], &profilePrev[0], n, overlap, is_calc,
+			track_pitch, &errors[0], bestmatch, match_array, start, end);
+
+	overlap[0] = (float(bestmatch.postion) + bestmatch.subsample) / n;
+}
+
+void CpuEngine::UseOverlap(const OverlapMatch &match)
+{
+	bestmatch = match;
+	overlap[0] = (float(bestmatch.postion) + bestmatch.subsample) /
+			samplesperframe;
+}
+
+//-----------------------------------------------------------------------------
+// The previous frame from the frame start down to where the current frame
+// starts again. In dual mono the last 1% fades into the current frame;
+// the shader leaves the stereo split unblended.
+
+void CpuEngine::AudioSamples(float *left, float *right) const
+{
+	int n = samplesperframe_file;
+	float top = overlap[3];
+	float bottom = 1.0f + overlap[3] - overlap[0];
+
+	for(int k=0; k<n; ++k)
+	{
+		float y = top + (k + 0.5f)/n * (bottom - top);
+
+		if(stereo == 0)
+		{
+			float v = Sample(prev.sound, y);
+			float yb = y - (1.0f - overlap[0]);
+
+			if(top - yb <= 0.01f && yb > 0)
+			{
+				float a = (top - yb)*100.0f;
+				v = Sample(cur.sound, yb)*(1-a) + v*a;
+			}
+
+			left[k] = right[k] = v;
+		}
+		else
+		{
+			left[k] = Sample(prev.left, y);
+			right[k] = Sample(prev.right, y);
+		}
+	}
+}
@@ -0,0 +1,163 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef CPUENGINE_H
+#define CPUENGINE_H
+
+#include <cstddef>
+#include <vector>
+
+#include "videoencoder.h"
+#include "tonecurve.h"
+#include "overlapsearch.h"
+
+// Software implementation of the extraction passes of Frame_Window.
+//
+// LoadFrame() streams the frame once, one scanline at a time: each row
+// of the strip covering the sound and picture bounds is unpacked to
+// lightness, blurred or sharpened, calibrated and tone mapped, and
+// reduced straight away to the per-row means that render modes 1.5 and
+// 4 average across the track. No full-size adjusted image is kept;
+// the working set is the few rows the 5x5 kernels reach.
+//
+// Columns outside the sound bounds are not adjusted, as in the shader.
+// The shader adjusts colour per channel and takes lightness of the row
+// means, so the two agree only on sources decoded to lightness.
+class CpuEngine
+{
+public:
+	CpuEngine();
+	~CpuEngine();
+
+	// per-row means of one frame, top row first
+	typedef struct {
+		std::vector<float> sound; // whole sound track
+		std::vector<float> left;  // left half of the sound track
+		std::vector<float> right; // right half
+		std::vector<float> pix;   // picture area
+	} RowMeans;
+
+	void LoadFrame(const FrameTexture *frame);
+	// take row means computed elsewhere (by a GL batch) as the next frame
+	void LoadRows(const RowMeans &rows);
+	void SetCalibrationMask(const float *mask, int n);
+
+	// Worst case difference of the fixed point row means from the float
+	// ones for the current parameters, in the 0-1 range. Valid after a
+	// frame has been loaded.
+	float FixedPointBound() const;
+	// Run both kernels on a frame and return the largest difference seen
+	// between their row means. Does not change the loaded frames.
+	float VerifyFixedPoint(const FrameTexture *frame);
+
+	// mode 4: 1d overlap profiles of the current and previous frame
+	void OverlapProfiles(float *cur, float *prev, int n) const;
+	// mode 5 and the search: sets bestmatch and overlap[0]; with
+	// track_pitch only around where the last frames lead
+	void FindOverlap();
+	// instead of FindOverlap(): the overlap found before, in
+	// samplesperframe units
+	void UseOverlap(const OverlapMatch &match);
+	// mode 1.5: samplesperframe_file samples of the previous frame
+	void AudioSamples(float *left, float *right) const;
+
+	const RowMeans &CurrentRows() const { return cur; }
+	const RowMeans &PreviousRows() const { return prev; }
+
+	// parameters, with the same meaning as in Frame_Window
+	float lift,gamma,gain;
+	float threshold,blur;
+	float stereo;
+	bool fixed_point; // 16-bit integer kernel instead of float
+	bool thresh;
+	bool negative;
+	bool cal_enabled;
+	bool is_calc;
+	bool track_pitch; // this frame follows the last one searched
+	float overlap_target; //0=sound 1= picture 2 = both
+	float bounds[4]; // x1,x2,y1,y2 as fractions of the frame
+	float overlap[4];
+	float pixbounds[2];
+	float rot_angle;
+	int samplesperframe;
+	int samplesperframe_file;
+
+	int input_w;
+	int input_h;
+
+	OverlapMatch bestmatch;
+	OverlapMatch match_array[5];
+
+private:
+	void Prepare(const FrameTexture *frame);
+	void Kernel(const FrameTexture *frame, RowMeans &means);
+	void KernelFixed(const FrameTexture *frame, RowMeans &means);
+	void SetStrip();
+	void UnpackRow(const FrameTexture *frame, int row, int x0, int n,
+			float *out) const;
+	void UnpackRow16(const FrameTexture *frame, int row, int x0, int n,
+			uint16_t *out) const;
+	void FetchRow(const FrameTexture *frame, int row, float *out);
+	void FetchRow16(const FrameTexture *frame, int row, uint16_t *out);
+	void FilterRow(const float *in, float *g, float *b5, float *b3) const;
+	float Calibration(int row) const;
+	static float Sample(const std::vector<float> &rows, float y);
+
+	int stripStart; // first frame column held in the strip
+	int stripWidth;
+	int adjStart; // strip columns inside the sound bounds
+	int adjEnd;
+	int pixStart; // strip columns of the picture area
+	int pixEnd;
+
+	ToneCurve tone;
+	OverlapSearch search;
+
+	RowMeans cur;
+	RowMeans prev;
+
+	std::vector<float> calMask;
+	std::vector<float> rotSource; // whole frame, only when rotating
+
+	// rows within reach of the vertical taps: the unpacked row and its
+	// horizontal Gaussian, box5 and box3 sums, indexed by row modulo
+	// CPU_RING_ROWS
+	std::vector<float> ringLuma;
+	std::vector<float> ringGauss;
+	std::vector<float> ringBox5;
+	std::vector<float> ringBox3;
+	std::vector<float> rowOut;
+
+	// the same for the fixed point kernel, in 16-bit units
+	std::vector<uint16_t> ringLuma16;
+	std::vector<uint16_t> ringGauss16;
+	std::vector<int32_t> ringBox5i;
+	std::vector<int32_t> ringBox3i;
+	std::vector<uint16_t> rowOut16;
+
+	std::vector<float> profileCur;
+	std::vector<float> profilePrev;
+	std::vector<float> errors;
+};
+
+#endif // CPUENGINE_H
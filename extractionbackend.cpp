@@ -0,0 +1,585 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "extractionbackend.h"
+#include "frame_view_gl.h"
+
+#include <QSettings>
+#include <QDebug>
+
+#include <algorithm>
+
+#if defined(__clang__)
+# pragma clang diagnostic push
+# pragma clang diagnostic ignored "-Wunsequenced"
+#endif
+#include "DspFilters/Dsp.h"
+#if defined(__clang__)
+# pragma clang diagnostic pop
+#endif
+
+#include "aeoexception.h"
+#include "overlapmap.h"
+#include "stagecache.h"
+
+ExtractionBackend::ExtractionBackend()
+{
+	FileRealBuffer = NULL;
+	numSamples = 0;
+	samplepointer = 0;
+	samplesperframe_file = 2000;
+	is_rendering = false;
+	stereo = 0;
+	lowPass = highPass = NULL;
+	processed = 0;
+	overlapMap = NULL;
+	reuseOverlap = false;
+	frameNumber = -1;
+	lastNumber = -1;
+	trackPitch = QSettings().value("extraction/track-pitch", true).toBool();
+}
+
+ExtractionBackend::~ExtractionBackend()
+{
+	if(FileRealBuffer) DestroyRecording();
+}
+
+ExtractionBackend *ExtractionBackend::Create(Frame_Window *window,
+		bool needVideo, bool lowLatency, bool lumaSource)
+{
+	QSettings settings;
+	settings.beginGroup("extraction");
+	QString name = settings.value("backend", "gl").toString();
+	int batchFrames = settings.value("batch-frames", 1).toInt();
+	settings.endGroup();
+
+	if(name == "cpu" && !needVideo && lumaSource)
+		return CreateCpu();
+
+	if(batchFrames > 1 && !needVideo && !lowLatency)
+		return new GLBatchBackend(window, batchFrames);
+
+	return new GLBackend(window);
+}
+
+ExtractionBackend *ExtractionBackend::CreateCpu()
+{
+	QSettings settings;
+
+	CpuBackend *cpu = new CpuBackend;
+	cpu->engine.fixed_point =
+			settings.value("extraction/fixed-point", false).toBool();
+	return cpu;
+}
+
+// the engine parameters of both backends that use a CpuEngine
+static void SetEngineParameters(CpuEngine &engine,
+		const ExtractionParameters &params)
+{
+	engine.lift = params.lift;
+	engine.gamma = params.gamma;
+	engine.gain = params.gain;
+	engine.threshold = params.threshold;
+	engine.blur = params.blur;
+	engine.stereo = params.stereo;
+	engine.thresh = params.thresh;
+	engine.negative = params.negative;
+	engine.cal_enabled = params.cal_enabled;
+	engine.is_calc = params.is_calc;
+	engine.overlap_target = params.overlap_target;
+	for(int i=0; i<4; ++i) engine.bounds[i] = params.bounds[i];
+	for(int i=0; i<4; ++i) engine.overlap[i] = params.overlap[i];
+	engine.pixbounds[0] = params.pixbounds[0];
+	engine.pixbounds[1] = params.pixbounds[1];
+	engine.rot_angle = params.rot_angle;
+}
+
+//-----------------------------------------------------------------------------
+// Overlap map
+
+bool ExtractionBackend::StoredOverlap(int n, OverlapMatch &match) const
+{
+	if(!overlapMap || !reuseOverlap || !overlapMap->Has(frameNumber))
+		return false;
+
+	match = overlapMap->Get(frameNumber, n).match;
+	return true;
+}
+
+void ExtractionBackend::KeepOverlap(const OverlapMatch &best, int n,
+		const float *overlap, bool calc)
+{
+	if(!overlapMap || frameNumber < 0) return;
+
+	OverlapMatch scaled = best;
+	if(n != overlapMap->SamplesPerFrame())
+	{
+		float pos = (best.postion + best.subsample) *
+				overlapMap->SamplesPerFrame() / n;
+		scaled.postion = int(pos + 0.5f);
+		scaled.subsample = pos - scaled.postion;
+	}
+
+	overlapMap->Set(frameNumber, scaled,
+			OverlapMap::Iffy(best, n, overlap, calc));
+}
+
+bool ExtractionBackend::Sequential()
+{
+	bool follows = frameNumber >= 0 && frameNumber == lastNumber + 1;
+	lastNumber = frameNumber;
+	return follows;
+}
+
+void ExtractionBackend::EngineOverlap(CpuEngine &engine)
+{
+	// the search follows the pitch only along a run of frames
+	engine.track_pitch = trackPitch && Sequential();
+
+	OverlapMatch stored;
+	if(StoredOverlap(engine.samplesperframe, stored))
+	{
+		engine.UseOverlap(stored);
+		return;
+	}
+
+	engine.FindOverlap();
+	KeepOverlap(engine.bestmatch, engine.samplesperframe, engine.overlap,
+			engine.is_calc);
+}
+
+//-----------------------------------------------------------------------------
+// Recording
+
+void ExtractionBackend::PrepareRecording(int numsamples, int samplesperframe)
+{
+	if(FileRealBuffer) DestroyRecording();
+
+	FileRealBuffer = new float* [2];
+
+	FileRealBuffer[0] = new float[numsamples];
+	FileRealBuffer[1] = new float[numsamples];
+
+	numSamples = numsamples;
+	samplesperframe_file = samplesperframe;
+	samplepointer = 0;
+}
+
+// Start writing at the beginning of the buffer again, after the samples
+// in it have been processed and used. The filters carry on from where
+// they were, so the output is continuous.
+void ExtractionBackend::RewindRecording()
+{
+	FinishRecording();
+
+	samplepointer = 0;
+	processed = 0;
+}
+
+void ExtractionBackend::DestroyRecording()
+{
+	FinishRecording();
+
+	if(FileRealBuffer)
+	{
+		delete [] FileRealBuffer[1];
+		delete [] FileRealBuffer[0];
+	}
+
+	delete[] FileRealBuffer ;
+	FileRealBuffer = NULL;
+	numSamples = 0;
+	samplepointer = 0;
+	is_rendering = false;
+
+	delete lowPass;
+	delete highPass;
+	lowPass = highPass = NULL;
+	processed = 0;
+}
+
+// Filters keep their state between calls, so the recording can be
+// processed piece by piece as it comes in, with the same result as in
+// one go.
+void ExtractionBackend::ProcessRecording(int numsamples)
+{
+	if(numsamples <= processed) return;
+
+	if(!lowPass)
+	{
+		lowPass =
+			new Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::LowPass, 2> (1024);
+		Dsp::Params hparams;
+		hparams[0] = 48000; // sample rate
+		hparams[1] = 13500; // cutoff frequency
+		hparams[2] = 4.5; // Q
+		lowPass->setParams (hparams);
+
+		highPass =
+			new Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::HighPass, 2> (1024);
+		Dsp::Params lparams;
+		lparams[0] = 48000; // sample rate
+		lparams[1] = 50; // cutoff frequency
+		lparams[2] = 1.5; // Q
+		highPass->setParams (lparams);
+	}
+
+	int n = numsamples - processed;
+	float *channels[2] = { FileRealBuffer[0] + processed,
+			FileRealBuffer[1] + processed };
+
+	lowPass->process (n, channels);
+	highPass->process (n, channels);
+
+	if (stereo == 2.0) //push pull
+	{
+		float phasefixed;
+		for (int i = 0; i< n; i++)
+		{
+			phasefixed =  ( channels[0][i]-channels[1][i]) /2.0;
+			channels[1][i]=phasefixed;
+			channels[0][i]=phasefixed;
+		}
+	}
+
+	processed = numsamples;
+}
+
+//-----------------------------------------------------------------------------
+// GL backend: the window renders the frame and, while recording, reads
+// mode 1.5 straight into our buffer.
+
+GLBackend::GLBackend(Frame_Window *w)
+{
+	window = w;
+
+	// "fft" (the default) reads the two profiles back and searches them on
+	// the CPU; "gpu" compares the offsets in mode 5 and finds the minimum
+	// in mode 6; "readback" reads the mode 5 errors back instead. The
+	// window keeps searching this way for the renders after the extraction.
+	QString search = QSettings().value("extraction/overlap-search",
+			"fft").toString();
+	window->fft_overlap = search != "gpu" && search != "readback";
+	window->gpu_match = search != "readback";
+
+	if(window->fft_overlap) name = "OpenGL";
+	else if(window->gpu_match) name = "OpenGL, GPU overlap search";
+	else name = "OpenGL, shader overlap search";
+}
+
+GLBackend::~GLBackend()
+{
+	// nothing may still be copied into the buffer once it is freed
+	try
+	{
+		if(FileRealBuffer) DestroyRecording();
+	}
+	catch(...)
+	{
+	}
+}
+
+void GLBackend::FinishRecording()
+{
+	window->FlushRecording();
+}
+
+long GLBackend::RecordedSamples() const
+{
+	if(!FileRealBuffer) return 0;
+
+	return window->RecordingCompleted(FileRealBuffer[0], samplepointer);
+}
+
+void GLBackend::SetParameters(const ExtractionParameters &params)
+{
+	window->SetParameters(params);
+	stereo = params.stereo;
+}
+
+void GLBackend::SetCalibrationMask(const float *mask, int n)
+{
+	if(n != window->cal_points)
+		throw AeoException("GL backend: calibration mask size mismatch");
+
+	window->SetCalibrationMask(mask);
+}
+
+bool GLBackend::LoadFrame(FrameTexture *frame)
+{
+	if(FileRealBuffer)
+		window->samplesperframe_file = samplesperframe_file;
+
+	window->SetRecordingBuffer(FileRealBuffer, samplepointer);
+	window->is_rendering = is_rendering && FileRealBuffer &&
+			samplepointer + samplesperframe_file <= numSamples;
+
+	window->fixed_overlap = StoredOverlap(window->samplesperframe,
+			window->fixed_match);
+	window->track_pitch = trackPitch && Sequential();
+
+	window->is_extracting = true;
+	window->load_frame_texture(frame);
+	window->renderNow();
+
+	samplepointer = window->RecordingPosition();
+	if(!window->fixed_overlap && window->rendered())
+		KeepOverlap(window->bestmatch, window->samplesperframe,
+				window->overlap, window->is_calc);
+
+	// leave the window displaying only
+	window->is_extracting = false;
+	window->is_rendering = false;
+	window->fixed_overlap = false;
+	window->track_pitch = false;
+	window->SetRecordingBuffer(NULL, 0);
+
+	return window->rendered();
+}
+
+OverlapMatch GLBackend::BestMatch() const
+{
+	return window->bestmatch;
+}
+
+int GLBackend::ErrorMetric() const
+{
+	return window->fft_overlap ? OVERLAP_ERROR_SQUARED :
+			OVERLAP_ERROR_ABSOLUTE;
+}
+
+float GLBackend::Overlap() const
+{
+	return window->overlap[0];
+}
+
+//-----------------------------------------------------------------------------
+// Batched GL backend
+
+GLBatchBackend::GLBatchBackend(Frame_Window *w, int frames)
+{
+	window = w;
+	batchFrames = frames;
+	queued = 0;
+}
+
+GLBatchBackend::~GLBatchBackend()
+{
+	try
+	{
+		if(FileRealBuffer) DestroyRecording();
+		if(window->makeContextCurrent()) window->EndBatch();
+	}
+	catch(...)
+	{
+	}
+}
+
+void GLBatchBackend::SetParameters(const ExtractionParameters &params)
+{
+	// frames already queued were loaded with the old parameters
+	Flush();
+
+	window->SetParameters(params);
+	SetEngineParameters(engine, params);
+	stereo = params.stereo;
+}
+
+void GLBatchBackend::SetCalibrationMask(const float *mask, int n)
+{
+	if(n != window->cal_points)
+		throw AeoException("GL backend: calibration mask size mismatch");
+
+	Flush();
+	window->SetCalibrationMask(mask);
+}
+
+bool GLBatchBackend::LoadFrame(FrameTexture *frame)
+{
+	if(queued == 0)
+	{
+		batchFrames = window->BeginBatch(batchFrames);
+		record.resize(batchFrames);
+		numbers.resize(batchFrames);
+	}
+
+	window->LoadBatchFrame(frame, queued);
+	record[queued] = is_rendering;
+	numbers[queued] = frameNumber;
+	++queued;
+
+	if(queued == batchFrames) Flush();
+
+	return true;
+}
+
+// lightness of an RGB mean, as Lightness() in the shader
+static float MeanLightness(const float *rgb)
+{
+	float hi = std::max(std::max(rgb[0], rgb[1]), rgb[2]);
+	float lo = std::min(std::min(rgb[0], rgb[1]), rgb[2]);
+	return (hi + lo) / 2;
+}
+
+void GLBatchBackend::Flush()
+{
+	if(queued == 0) return;
+
+	int h = window->input_h;
+	rows.resize(size_t(queued) * h * 12);
+	int frames = queued;
+	queued = 0;
+	window->RenderBatch(frames, &rows[0]);
+
+	means.sound.resize(h);
+	means.left.resize(h);
+	means.right.resize(h);
+	means.pix.resize(h);
+
+	engine.samplesperframe_file = samplesperframe_file;
+	for(int f=0; f<frames; ++f)
+	{
+		// per row: RGBA means of the left half, right half and picture
+		for(int y=0; y<h; ++y)
+		{
+			const float *row = &rows[(size_t(f) * h + y) * 12];
+			float sound[3];
+			for(int c=0; c<3; ++c) sound[c] = (row[c] + row[4+c]) / 2;
+
+			means.left[y] = MeanLightness(row);
+			means.right[y] = MeanLightness(row + 4);
+			means.pix[y] = MeanLightness(row + 8);
+			means.sound[y] = MeanLightness(sound);
+		}
+
+		engine.LoadRows(means);
+		frameNumber = numbers[f];
+		EngineOverlap(engine);
+
+		if(record[f] && FileRealBuffer &&
+				samplepointer + samplesperframe_file <= numSamples)
+		{
+			engine.AudioSamples(&FileRealBuffer[0][samplepointer],
+					&FileRealBuffer[1][samplepointer]);
+			samplepointer += samplesperframe_file;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// CPU backend
+
+CpuBackend::CpuBackend()
+{
+	params = ExtractionParameters();
+	stageCache = NULL;
+	rowsKey = 0;
+	uncached = -1;
+	verified = false;
+}
+
+void CpuBackend::SetParameters(const ExtractionParameters &p)
+{
+	params = p;
+	SetEngineParameters(engine, params);
+	stereo = params.stereo;
+}
+
+void CpuBackend::SetCalibrationMask(const float *mask, int n)
+{
+	calMask.assign(mask, mask + 2*n);
+
+	// the engine reads the first column only
+	std::vector<float> column(n);
+	for(int i=0; i<n; ++i) column[i] = mask[2*i];
+
+	engine.SetCalibrationMask(&column[0], n);
+}
+
+void CpuBackend::SetStageCache(StageCache *cache, const std::string &source)
+{
+	stageCache = cache;
+	stageSource = source;
+}
+
+bool CpuBackend::LoadCachedFrame(long number)
+{
+	uncached = -1;
+	if(!stageCache) return false;
+
+	// the parameters may have changed since the last frame
+	rowsKey = StageCache::RowsKey(stageSource, params, engine.fixed_point,
+			calMask.empty() ? NULL : &calMask[0], int(calMask.size() / 2));
+
+	CpuEngine::RowMeans rows;
+	if(!stageCache->GetRows(rowsKey, number, rows))
+	{
+		uncached = number;
+		return false;
+	}
+
+	engine.LoadRows(rows);
+	Process();
+	return true;
+}
+
+bool CpuBackend::LoadFrame(FrameTexture *frame)
+{
+	// the first frame checks the fixed point kernel against its error
+	// bound; past it the float kernel takes over
+	if(engine.fixed_point && !verified)
+	{
+		verified = true;
+		float worst = engine.VerifyFixedPoint(frame);
+		float bound = engine.FixedPointBound();
+		if(worst > bound)
+		{
+			qWarning("CPU engine: fixed point row means off by %g, "
+					"more than the bound %g; using float",
+					double(worst), double(bound));
+			engine.fixed_point = false;
+		}
+	}
+
+	engine.LoadFrame(frame);
+	if(stageCache && uncached >= 0)
+		stageCache->PutRows(rowsKey, uncached, engine.CurrentRows());
+	uncached = -1;
+
+	Process();
+	return true;
+}
+
+void CpuBackend::Process()
+{
+	EngineOverlap(engine);
+
+	if(is_rendering && FileRealBuffer &&
+			samplepointer + samplesperframe_file <= numSamples)
+	{
+		engine.samplesperframe_file = samplesperframe_file;
+		engine.AudioSamples(&FileRealBuffer[0][samplepointer],
+				&FileRealBuffer[1][samplepointer]);
+		samplepointer += samplesperframe_file;
+	}
+}
@@ -0,0 +1,244 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef EXTRACTIONBACKEND_H
+#define EXTRACTIONBACKEND_H
+
+#include <string>
+
+#include <QtGlobal>
+
+#include "videoencoder.h"
+#include "overlapsearch.h"
+#include "cpuengine.h"
+
+class Frame_Window;
+class StageCache;
+class OverlapMap;
+namespace Dsp { class Filter; }
+
+// The part of the Frame_Window settings that decides which samples come
+// out of a frame. Display settings (zoom, overlap view, track only) are
+// not included.
+typedef struct {
+	float lift,gamma,gain;
+	float threshold,blur;
+	float stereo;
+	bool thresh;
+	bool negative;
+	bool cal_enabled;
+	bool is_calc;
+	float overlap_target; //0=sound 1= picture 2 = both
+	float bounds[4]; // boundry of track area x1,x2,y1,y2
+	float overlap[4];
+	float pixbounds[2];
+	float rot_angle;
+} ExtractionParameters;
+
+// Turns a sequence of frames into a soundtrack, independently of how the
+// frames are displayed. LoadFrame() runs every pass on the new frame and,
+// while recording, appends the samples of the previous frame: those are
+// only final once the overlap with the new frame is known.
+class ExtractionBackend
+{
+public:
+	ExtractionBackend();
+	virtual ~ExtractionBackend();
+
+	// the backend named by the "extraction/backend" setting. A video
+	// output needs the rendered image, so it always gets the GL backend.
+	// Batches are not used when each frame is wanted as soon as possible.
+	// The CPU backend takes lightness before tone mapping and averaging,
+	// where the shader does it after, so it is only used when the source
+	// decodes to lightness (lumaSource) and the two agree.
+	static ExtractionBackend *Create(Frame_Window *window,
+			bool needVideo = false, bool lowLatency = false,
+			bool lumaSource = false);
+	// a CpuBackend as configured, for extractions without the window;
+	// the same as the GL backends only for lightness sources
+	static ExtractionBackend *CreateCpu();
+
+	virtual const char *Name() const = 0;
+	// true if frames are processed by rendering the window
+	virtual bool UsesWindow() const = 0;
+	// the overlap search follows the pitch along runs of frames
+	bool TracksPitch() const { return trackPitch; }
+
+	virtual void SetParameters(const ExtractionParameters &params) = 0;
+	// in the GL layout: 2 columns by n rows
+	virtual void SetCalibrationMask(const float *mask, int n) = 0;
+	virtual bool LoadFrame(FrameTexture *frame) = 0;
+	// Process frame number from what a stage cache kept of it, if it can;
+	// otherwise false, and the frame has to be decoded and LoadFrame()'d.
+	virtual bool LoadCachedFrame(long) { return false; }
+	// the frame loaded next, counted from the source's first frame
+	void SetFrameNumber(long number) { frameNumber = number; }
+
+	// Keep the overlap found for each frame in map. With reuse, the
+	// frames the map has take their overlap from it instead of a search.
+	void SetOverlapMap(OverlapMap *map, bool reuse)
+		{ overlapMap = map; reuseOverlap = reuse; }
+
+	// overlap of the last two frames loaded
+	virtual OverlapMatch BestMatch() const = 0;
+	// what the value of BestMatch() measures
+	virtual int ErrorMetric() const { return OVERLAP_ERROR_SQUARED; }
+	virtual float Overlap() const = 0; // as a fraction of the frame
+
+	void PrepareRecording(int numsamples, int samplesperframe);
+	void SetRecording(bool on) { is_rendering = on; }
+	// wait for samples still on their way; GetRecording() is complete after
+	virtual void FinishRecording() {}
+	// samples at the start of the buffer that are final
+	virtual long RecordedSamples() const { return samplepointer; }
+	// no room for the samples of another frame
+	bool RecordingFull() const
+		{ return samplepointer + samplesperframe_file > numSamples; }
+	void RewindRecording();
+	// filter the samples before numsamples that are not filtered yet
+	void ProcessRecording(int numsamples);
+	void DestroyRecording();
+	float **GetRecording() const { return FileRealBuffer; }
+
+protected:
+	// the stored overlap of the frame being loaded, if it is to be used
+	bool StoredOverlap(int n, OverlapMatch &match) const;
+	void KeepOverlap(const OverlapMatch &best, int n, const float *overlap,
+			bool calc);
+	// the overlap of the frame just loaded into engine, stored or searched
+	void EngineOverlap(CpuEngine &engine);
+	// the frame being loaded follows the one loaded before it
+	bool Sequential();
+
+	float **FileRealBuffer;
+	long numSamples;
+	long samplepointer;
+	Dsp::Filter *lowPass, *highPass;
+	long processed; // samples filtered
+	int samplesperframe_file;
+	bool is_rendering;
+	float stereo;
+	OverlapMap *overlapMap;
+	bool reuseOverlap;
+	long frameNumber;
+	long lastNumber;
+	bool trackPitch; // the "extraction/track-pitch" setting
+};
+
+// The shader passes of Frame_Window
+class GLBackend : public ExtractionBackend
+{
+public:
+	GLBackend(Frame_Window *window);
+	~GLBackend();
+
+	const char *Name() const { return name; }
+	bool UsesWindow() const { return true; }
+
+	void SetParameters(const ExtractionParameters &params);
+	void SetCalibrationMask(const float *mask, int n);
+	bool LoadFrame(FrameTexture *frame);
+	void FinishRecording();
+	long RecordedSamples() const;
+
+	OverlapMatch BestMatch() const;
+	int ErrorMetric() const;
+	float Overlap() const;
+
+private:
+	Frame_Window *window;
+	const char *name; // with the "extraction/overlap-search" setting
+};
+
+// The adjustment and row mean passes of Frame_Window, run on batches of
+// frames stacked in one texture; the overlap search and the samples are
+// computed from the row means read back, by a CpuEngine. The frames of a
+// batch are only processed when it is full or the recording finishes, so
+// there is no preview.
+class GLBatchBackend : public ExtractionBackend
+{
+public:
+	GLBatchBackend(Frame_Window *window, int frames);
+	~GLBatchBackend();
+
+	const char *Name() const { return "OpenGL batched"; }
+	bool UsesWindow() const { return true; }
+
+	void SetParameters(const ExtractionParameters &params);
+	void SetCalibrationMask(const float *mask, int n);
+	bool LoadFrame(FrameTexture *frame);
+	void FinishRecording() { Flush(); }
+
+	OverlapMatch BestMatch() const { return engine.bestmatch; }
+	float Overlap() const { return engine.overlap[0]; }
+
+private:
+	void Flush();
+
+	Frame_Window *window;
+	CpuEngine engine;
+	int batchFrames;
+	int queued;
+	std::vector<bool> record; // is_rendering when each frame was queued
+	std::vector<long> numbers; // frame number of each
+	std::vector<float> rows;
+	CpuEngine::RowMeans means;
+};
+
+// CpuEngine, which needs no OpenGL context. With a stage cache, the row
+// means of each frame are kept, and a frame whose rows are there already
+// is not decoded or adjusted again.
+class CpuBackend : public ExtractionBackend
+{
+public:
+	CpuBackend();
+
+	const char *Name() const { return "CPU"; }
+	bool UsesWindow() const { return false; }
+
+	void SetParameters(const ExtractionParameters &params);
+	void SetCalibrationMask(const float *mask, int n);
+	bool LoadFrame(FrameTexture *frame);
+	bool LoadCachedFrame(long number);
+
+	// source identifies the decoded images (FilmScan::CacheKey())
+	void SetStageCache(StageCache *cache, const std::string &source);
+
+	OverlapMatch BestMatch() const { return engine.bestmatch; }
+	float Overlap() const { return engine.overlap[0]; }
+
+	CpuEngine engine;
+
+private:
+	void Process(); // the overlap and audio of the frame just loaded
+
+	ExtractionParameters params;
+	std::vector<float> calMask; // in the GL layout
+	StageCache *stageCache;
+	std::string stageSource;
+	quint64 rowsKey;
+	long uncached; // frame to keep the rows of at the next LoadFrame()
+	bool verified; // fixed point kernel checked against its bound
+};
+
+#endif // EXTRACTIONBACKEND_H
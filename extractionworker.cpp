@@ -0,0 +1,146 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "extractionworker.h"
+#include "extractionbackend.h"
+
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <exception>
+
+#include "aeoexception.h"
+
+// least time between Progress() signals, in milliseconds
+#define PROGRESS_INTERVAL 100
+
+ExtractionWorker::ExtractionWorker(const FilmScan &source,
+		ExtractionBackend *b, long first, long num, QObject *parent)
+	: ExtractionWorker(source, std::vector<ExtractionBackend *>(1, b),
+			first, num, parent)
+{
+}
+
+ExtractionWorker::ExtractionWorker(const FilmScan &source,
+		const std::vector<ExtractionBackend *> &b, long first, long num,
+		QObject *parent)
+	: QThread(parent)
+{
+	sourceName = source.GetFileName();
+	sourceFormat = source.GetFormat();
+	lumaOnly = source.IsLumaOnly();
+	cache = source.GetFrameCache();
+	strip = source.GetStripCache();
+	cacheFill = source.FillsFrameCache();
+	backends = b;
+	firstFrame = first;
+	numFrames = num;
+	frame = NULL;
+}
+
+ExtractionWorker::~ExtractionWorker()
+{
+	Cancel();
+	wait();
+	delete frame;
+}
+
+QString ExtractionWorker::Throughput(long done, long total, double seconds)
+{
+	if(done <= 0 || seconds <= 0) return QString();
+
+	double fps = done / seconds;
+	long left = long((total - done) / fps + 0.5);
+
+	return QString("%1 fps, %2:%3 left").arg(fps, 0, 'f', 1).
+			arg(left / 60).arg(left % 60, 2, 10, QChar('0'));
+}
+
+void ExtractionWorker::Load(long n)
+{
+	// the last frame is loaded twice, as on the GUI thread
+	if(firstFrame + n > scan.NumFrames()-1) --n;
+
+	// decoded only if a backend has not kept what it needs of it
+	bool decoded = false;
+	for(size_t i=0; i<backends.size(); ++i)
+	{
+		backends[i]->SetFrameNumber(firstFrame + n);
+		if(backends[i]->LoadCachedFrame(firstFrame + n)) continue;
+
+		if(!decoded)
+		{
+			frame = scan.GetFrameImage(scan.FirstFrame() + firstFrame + n,
+					frame);
+			decoded = true;
+		}
+
+		if(!backends[i]->LoadFrame(frame))
+			throw AeoException(QString("Frame %1 was not processed").
+					arg(firstFrame + n));
+	}
+}
+
+void ExtractionWorker::run()
+{
+	try
+	{
+		if(!scan.Source(sourceName, sourceFormat))
+			throw AeoException(QString("Cannot open %1").
+					arg(QString::fromStdString(sourceName)));
+		scan.SetLumaOnly(lumaOnly);
+		scan.SetFrameCache(cache, cacheFill);
+		scan.SetStripCache(strip);
+
+		QElapsedTimer timer;
+		timer.start();
+		qint64 reported = 0;
+
+		Load(0);
+		for(size_t i=0; i<backends.size(); ++i)
+			backends[i]->SetRecording(true);
+
+		for(long a = 1; a <= numFrames && !Canceled(); ++a)
+		{
+			Load(a);
+
+			qint64 ms = timer.elapsed();
+			if(ms - reported >= PROGRESS_INTERVAL || a == numFrames)
+			{
+				double fps = a * 1.0e3 / std::max<qint64>(ms, 1);
+				emit Progress(a, fps, (numFrames - a) / fps);
+				reported = ms;
+			}
+		}
+
+		for(size_t i=0; i<backends.size(); ++i)
+		{
+			backends[i]->SetRecording(false);
+			backends[i]->FinishRecording();
+		}
+	}
+	catch(std::exception &e)
+	{
+		error = QString(e.what());
+	}
+}
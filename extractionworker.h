@@ -0,0 +1,95 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef EXTRACTIONWORKER_H
+#define EXTRACTIONWORKER_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QString>
+
+#include <vector>
+
+#include "FilmScan.h"
+
+class ExtractionBackend;
+
+// Runs an extraction whose backend needs no OpenGL context on a thread of
+// its own, decoding from its own copy of the source so the GUI thread
+// keeps its FilmScan for display. The backend must have its parameters
+// set and its recording prepared; frames firstFrame to
+// firstFrame+numFrames are loaded as WriteAudioToFile() loads them, the
+// first one before recording starts. Progress() is emitted a few times
+// per second and, being a signal across threads, arrives queued.
+//
+// Given several backends, each frame is decoded once and loaded into all
+// of them, so that parameter sets can be compared for one decode.
+class ExtractionWorker : public QThread
+{
+	Q_OBJECT
+
+public:
+	ExtractionWorker(const FilmScan &source, ExtractionBackend *backend,
+			long firstFrame, long numFrames, QObject *parent = 0);
+	ExtractionWorker(const FilmScan &source,
+			const std::vector<ExtractionBackend *> &backends,
+			long firstFrame, long numFrames, QObject *parent = 0);
+	~ExtractionWorker();
+
+	// stop after the frame being processed; safe from any thread
+	void Cancel() { cancel.storeRelaxed(1); }
+	bool Canceled() const { return cancel.loadRelaxed() != 0; }
+	// what stopped the extraction, empty if it ran to the end or was
+	// canceled
+	QString Error() const { return error; }
+
+	// "n fps, m:ss left" for a progress label
+	static QString Throughput(long done, long total, double seconds);
+
+signals:
+	// frames done of numFrames, frames per second, seconds left
+	void Progress(long done, double fps, double eta);
+
+protected:
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	void Load(long frame);
+
+	std::string sourceName;
+	SourceFormat sourceFormat;
+	bool lumaOnly;
+	FrameCache *cache;
+	StripCache *strip;
+	bool cacheFill;
+	std::vector<ExtractionBackend *> backends;
+	long firstFrame;
+	long numFrames;
+
+	FilmScan scan;
+	FrameTexture *frame;
+	QAtomicInt cancel;
+	QString error;
+};
+
+#endif // EXTRACTIONWORKER_H
@@ -9,6 +9,11 @@ uniform sampler2D prev_audio_tex;
 uniform sampler2D overlap_audio_tex;
 uniform sampler2D overlapcompute_audio_tex;
 uniform sampler2D cal_audio_tex;
+uniform sampler1D tone_lut_tex; // r: tone curve, g: levels only, b: S-curve only
+uniform sampler2D reduce_tex; // previous mode 6 pass
+uniform sampler2D row_tex; // previous mode 7/8 pass
+uniform sampler2D row_mean_tex; // row means of adj_frame_tex: left half, right half, picture
+uniform sampler2D prev_row_mean_tex; // the same for prev_frame_tex
 uniform float overlapshow;
 uniform float rot_angle;
 uniform float render_mode;
@@ -24,9 +29,63 @@ uniform vec4 color_controls; //lift, gamma, gain,sat;
 uniform vec3 manip_controls; //thresh,threshold amount,  blur
 uniform vec4 overlap; //   y_search Area ,y_ offset,  bottom,  top;
 uniform vec4 cal_controls;
+uniform vec2 tone_lut_coord; // scale and offset onto the texel centres
+uniform float luma_input; // 1.0: frame_tex is R16 lightness, the rest is grey
+uniform vec4 reduce_controls; // first pass, input width, samples, reduce_tex width
+uniform vec2 reduce_window[6]; // first and last error index of each search window
+uniform vec4 row_controls; // source (0 adj, 1 prev), taps, segments per range in, ROW_SEGMENTS
+uniform vec2 batch_frames; // frames drawn, frames stacked in frame_tex; 1,1 unless batching
 //out int ucol;
 
 
+vec4 ToneLookup(float v)
+{
+    return texture1D(tone_lut_tex, clamp(v,0.0,1.0)*tone_lut_coord.x + tone_lut_coord.y);
+}
+
+
+float batch_tile = 0.0; // frame of the batch being adjusted
+
+vec4 FrameTexel(vec2 coord)
+{
+    // stay inside this frame of a stacked batch
+    if (batch_frames.y > 1.0)
+        coord.y = (batch_tile + clamp(coord.y, 0.5/inputsize.y, 1.0-0.5/inputsize.y))/batch_frames.y;
+    vec4 t = texture2D(frame_tex, coord);
+    return (luma_input==1.0) ? vec4(t.rrr, 1.0) : t;
+}
+
+// mean of row y between the range's bounds: 0 left half of the track,
+// 1 right half, 2 picture
+vec4 RowMean(sampler2D rows, float range, float y)
+{
+    return texture2D(rows, vec2((range+0.5)/3.0, y));
+}
+
+// mean over the sound track, its first half for push pull
+vec4 SoundMean(sampler2D rows, float y)
+{
+    vec4 left = RowMean(rows, 0.0, y);
+    if (isstereo==2.0)
+        return left;
+    return (left + RowMean(rows, 1.0, y))/2.0;
+}
+
+// mode 5 error at index i
+float OverlapError(float i)
+{
+    return texture2D(overlapcompute_audio_tex, vec2(0.25,(i+0.5)/reduce_controls.z)).r;
+}
+
+// as OverlapSearch::RefineMinimum()
+float RefineMinimum(float l, float c, float r)
+{
+    float curve = l - 2.0*c + r;
+    if (curve <= 0.0)
+        return 0.0;
+    return clamp(0.5*(l - r)/curve, -0.5, 0.5);
+}
+
 vec3 RGBToHSL(vec3 color)
 {
     vec3 hsl; // init to 0 to avoid warnings ? (and reverse if + remove first part)
@@ -69,6 +128,11 @@ vec3 RGBToHSL(vec3 color)
     return hsl;
 }
 
+float Lightness(vec4 color)
+{
+    return (luma_input==1.0) ? color.r : RGBToHSL(color.xyz).z;
+}
+
 float HueToRGB(float f1, float f2, float hue)
 {
     if (hue < 0.0)
@@ -227,6 +291,9 @@ void main(void)
 
     if (render_mode==0.0)    //// first pass corrections render
     {
+        // a batch draws its frames stacked bottom up in one pass
+        batch_tile = floor(vTexCoord.y*batch_frames.x);
+        vec2 frame_coord = vec2(vTexCoord.x, vTexCoord.y*batch_frames.x - batch_tile);
 
         vec4 sharp_texel =vec4(0);
         vec4 blur_texel =vec4(0);
@@ -245,12 +312,12 @@ void main(void)
                                         -s,  c);
 
 
-vec2  vTexRotated = vTexCoord-vec2(0.5,0.5);
+vec2  vTexRotated = frame_coord-vec2(0.5,0.5);
 vTexRotated = vTexRotated*rotMatrix;
 
 vTexRotated = vTexRotated +vec2(0.5,0.5);
 
-        texel = texture2D(frame_tex, vTexRotated);
+        texel = FrameTexel(vTexRotated);
         if(cal_controls.y==1.0)
         {
             grabberm =  vec2(4.0,4.0);
@@ -260,7 +327,7 @@ vTexRotated = vTexRotated +vec2(0.5,0.5);
             grabberm =vec2(1.0);
         }
 
-        if( vTexCoord.x < bounds.y && vTexCoord.x > bounds.x)
+        if( frame_coord.x < bounds.y && frame_coord.x > bounds.x)
 
         {
             for( k=0; k<25; k++ )
@@ -272,7 +339,7 @@ vTexRotated = vTexRotated +vec2(0.5,0.5);
 
 
 
-                tmps = texture2D(frame_tex,grabber*rotMatrix);
+                tmps = FrameTexel(grabber*rotMatrix);
 
                 sharp_texel+=tmps*KERNEL_HSHARPEN [k];
                 blur_texel+=(tmps *KERNEL_HBLUR [k]);
@@ -290,31 +357,29 @@ vTexRotated = vTexRotated +vec2(0.5,0.5);
                     vec4        cal_texel=vec4(0.0);
 
 
-                    cal_texel =  texture2D(cal_audio_tex, vec2(.25,1.0-vTexCoord.y));
+                    cal_texel =  texture2D(cal_audio_tex, vec2(.25,1.0-frame_coord.y));
                     texel*=vec4(0.5/cal_texel.x);
 
 
                 }
 
 
-                if(negative==1.0)
-                    texel=vec4(1.0)-texel;//neg flip
-                texel+=vec4(color_controls.x); //lift should chnage to neg gain?
-                texel=clamp(texel,vec4(0),vec4(1.0));
-                texel=pow(texel,vec4(color_controls.y)); //gamma
-                texel*=vec4(color_controls.z);           //gain
-                texel=clamp(texel,vec4(0),vec4(1.0));
-                texel.xyz=RGBToHSL(texel.xyz);
-                texel.y  *= color_controls.a; //saturation
-
-                texel.xyz=HSLToRGB(texel.xyz);
-
-                if (manip_controls.x==1.0)//threshold boolean
+                // negative, lift, gamma, gain and S-curve are tabulated in
+                // tone_lut_tex. Full saturation is the identity, so only
+                // desaturation needs the lightness between the two halves.
+                if(luma_input==1.0)
                 {
-
-                    texel = pow(texel,vec4(manip_controls.y)) / ((pow(vec4(0.5),vec4(manip_controls.y))) +pow(texel,vec4(manip_controls.y)) ); //sigmoid function
-
-
+                    texel.xyz = vec3(ToneLookup(texel.r).r);
+                }
+                else if(color_controls.a==0.0)
+                {
+                    vec3 lev = vec3(ToneLookup(texel.r).g, ToneLookup(texel.g).g, ToneLookup(texel.b).g);
+                    float light = (max(max(lev.r, lev.g), lev.b) + min(min(lev.r, lev.g), lev.b)) / 2.0;
+                    texel.xyz = vec3(ToneLookup(light).b);
+                }
+                else
+                {
+                    texel.xyz = vec3(ToneLookup(texel.r).r, ToneLookup(texel.g).r, ToneLookup(texel.b).r);
                 }
             }
             else
@@ -331,165 +396,110 @@ vTexRotated = vTexRotated +vec2(0.5,0.5);
 
 
     }
-    if (render_mode==1.0) //sound render internal for display purposes
+    if (render_mode==7.0) // row means, first pass: row_controls.w segments per range
     {
-        texel = vec4(0);
-        vec4 ptex = vec4(0);
-        float samplesperline = 2048.0;
-        float trackwidth=  bounds.y -bounds.x;
+        // column: range (left half of the track, right half, picture) *
+        // row_controls.w + segment; each segment averages row_controls.y taps
+        float col = floor(gl_FragCoord.x);
+        float range = floor(col/row_controls.w);
+        float seg = col - range*row_controls.w;
+        float y = gl_FragCoord.y/(inputsize.y*batch_frames.y);
+        float mid = bounds.x + (bounds.y - bounds.x)/2.0;
+        vec2 span = vec2(bounds.x, mid);
+        if (range == 1.0)
+            span = vec2(mid, bounds.y);
+        if (range == 2.0)
+            span = pix_boundry;
+        float segw = (span.y - span.x)/row_controls.w;
 
-        float track_iter= trackwidth/1024.0;
-        if (isstereo ==2.0)
-            track_iter/=2.0;  //Push pull one half ;
-        for(int i =0 ; i<1024; i++)
+        texel = vec4(0);
+        for(int k=0; k<256; k++)
         {
-
-
-            texel += texture2D(adj_frame_tex, vec2(bounds.x+(float(i)*track_iter),1.0-vTexCoord.y)); //steps through track bounded line 1024 times
-            ptex  += texture2D(prev_frame_tex, vec2(bounds.x+(float(i)*track_iter),overlap.a- 1.0-vTexCoord.y)); //steps through track bounded line 1024 times
+            if (float(k) >= row_controls.y)
+                break;
+            vec2 c = vec2(span.x + (seg + (float(k)+0.5)/row_controls.y)*segw, y);
+            if (row_controls.x == 0.0)
+                texel += texture2D(adj_frame_tex, c);
+            else
+                texel += texture2D(prev_frame_tex, c);
         }
+        texel /= vec4(row_controls.y);
+    }
+    if (render_mode==8.0) // row means, halving pass
+    {
+        // row_controls.z segments per range in, half as many out; row_tex
+        // is 3*row_controls.w wide
+        float col = floor(gl_FragCoord.x);
+        float outw = row_controls.z/2.0;
+        float range = floor(col/outw);
+        float i = range*row_controls.z + 2.0*(col - range*outw);
+        float y = gl_FragCoord.y/(inputsize.y*batch_frames.y);
+
+        texel = (texture2D(row_tex, vec2((i+0.5)/(3.0*row_controls.w), y)) +
+                 texture2D(row_tex, vec2((i+1.5)/(3.0*row_controls.w), y))) / 2.0;
+    }
 
-        texel/=vec4(1024.0);
-        texel = vec4(RGBToHSL(texel.xyz).z);
-
-        ptex/=vec4(1024.0);
-        ptex = vec4(RGBToHSL(texel.xyz).z);
-
+    if (render_mode==1.0) //sound render internal for display purposes
+    {
+        texel = SoundMean(row_mean_tex, 1.0-vTexCoord.y); // push pull: one half
+        texel = vec4(Lightness(texel));
 
         // tonegenerator       texel=vec4(sin(3.14159*100*(1.0-vTexCoord.y)) +1.0)/2.0;
     }
     if (render_mode==1.5)   //sounder render for file output
     {
-        texel = vec4(0);
         vec4 ptex = vec4(0);
-        vec4 ctex = vec4(0);
-        float samplesperline = 2048.0;  // 2048 samples inside track defined area
         float trackwidth=  bounds.y -bounds.x;
-        float track_iter= trackwidth/samplesperline;
         float ypblend =0;
 
         if (isstereo ==0.0) //is stereo output ?
         {
             ypblend = (vTexCoord.y -(1.0-overlap.x) );// - (1.0 + (overlap.z - overlap.x)   +overlap.a );
-            for(int i =0 ; i<int(samplesperline); i++)
-            {
-
-
-                texel += texture2D(prev_frame_tex, vec2(bounds.x+(float(i)*track_iter),vTexCoord.y)); //current frame sound
-                ptex += texture2D(adj_frame_tex, vec2(bounds.x+(float(i)*track_iter), ypblend )); //prev frame sound
-
-
-
-            }
-
-
-
+            texel = (RowMean(prev_row_mean_tex, 0.0, vTexCoord.y) + RowMean(prev_row_mean_tex, 1.0, vTexCoord.y))/2.0; //current frame sound
+            ptex = (RowMean(row_mean_tex, 0.0, ypblend) + RowMean(row_mean_tex, 1.0, ypblend))/2.0; //prev frame sound
         }
 
         else //mono output
         {
-            samplesperline = samplesperline/2.0;
             if (flip_coord.x<(bounds.x+(trackwidth/2.0)))
-            {
-                for(int i =0 ; i<int(samplesperline); i++)
-                {
-
-
-                    texel += texture2D(prev_frame_tex, vec2(bounds.x+(float(i)*track_iter),1.0-flip_coord.y));//current frame sound
-                    ptex += texture2D(adj_frame_tex, vec2(bounds.x+(float(i)*track_iter), ypblend ));//prev frame sound
-
-
-                }
-
-            }
+                texel = RowMean(prev_row_mean_tex, 0.0, 1.0-flip_coord.y);//current frame sound
             else
-            {
-                for(int i =0 ; i<int(samplesperline); i++)
-                {
-
-
-                    texel += texture2D(prev_frame_tex, vec2((bounds.x+(trackwidth/2.0))+(float(i)*track_iter),1.0-flip_coord.y));//current frame sound
-                    ptex += texture2D(adj_frame_tex, vec2(bounds.x+(float(i)*track_iter), ypblend ));//prev frame sound
-
-
-                }
-
-            }
-
+                texel = RowMean(prev_row_mean_tex, 1.0, 1.0-flip_coord.y);//current frame sound
         }
         if (overlap.a - ypblend <= 0.01 && ypblend>0.0)//overlap blend 1% take prev and curr and blend linear scale over overlap
         {
 
             texel =mix(ptex,texel,(overlap.a - ypblend)*100.0);
         }
-        texel/=vec4(samplesperline);
-        texel= pow(texel,vec4(1.0));
-        texel = vec4(RGBToHSL(texel.xyz).z); //convert to luminance
+        texel = vec4(Lightness(texel)); //convert to luminance
 
 
 
     }
     if (render_mode==4.0) //sound ovelrap render with pix match to 1d array
     {
-
-        float trackwidth=  bounds.y -bounds.x;    //sound area
-        float trackwidthpix=  pix_boundry.y -pix_boundry.x; //pix area
-        float track_iterpix= trackwidthpix/1024.0;
-        float track_iter= trackwidth/1024.0;
-        if (isstereo ==2.0)
-            track_iter/=2.0;  //Push pull one half ;
-        vec4 qtexel = vec4(0);
-        vec4 pqtexel = vec4(0);
-        texel = vec4(0);
         vec4 pix_texel = vec4(0);
 
-
         if (flip_coord.x<0.5) //current frame ouput 1d compare array
         {
-            for(int i =0 ; i<1024; i++)
-            {
-
-                texel +=( texture2D(adj_frame_tex, vec2(bounds.x+(float(i)*track_iter), vTexCoord.y))   * vec4(1.0/1024.0 ));   //column0 curr frame sound
-
-                pix_texel +=( texture2D(adj_frame_tex, vec2(pix_boundry.x+(float(i)*track_iterpix), vTexCoord.y))   * vec4(1.0/1024.0 ));   //column0 curr frame sound
-
-
-
-
-
-            }
-            if (overlap_target ==1.0)
-                texel=pix_texel;
-            if (overlap_target == 2.0)
-                texel= (texel + pix_texel)/2.0;
-
-            texel -= vec4(dminmax.x);
-            texel *= vec4(1.0/(dminmax.y-dminmax.x));  // auto range based off of min and max values detected on current frame and apply to previous
+            texel = SoundMean(row_mean_tex, vTexCoord.y);   //column0 curr frame sound
+            pix_texel = RowMean(row_mean_tex, 2.0, vTexCoord.y);
         }
         else  //previous frame ouput 1d compare array
         {
-            for(int i =0 ; i<1024; i++)
-            {
-
-                texel+= ((texture2D(prev_frame_tex, vec2(bounds.x+(float(i)*track_iter),vTexCoord.y))) *vec4(1.0/1024.0 ));      //column1 previous frame pix
-                pix_texel+= ((texture2D(prev_frame_tex, vec2(pix_boundry.x+(float(i)*track_iterpix),vTexCoord.y))) *vec4(1.0/1024.0 ));      //column1 previous frame pix
-
-
-            }
-
-            if (overlap_target == 1.0)
-                texel=pix_texel;
-            if (overlap_target == 2.0)
-                texel= (texel + pix_texel)/2.0;
-
-
-            texel -= vec4(dminmax.x);
-            texel *= vec4(1.0/(dminmax.y-dminmax.x));
+            texel = SoundMean(prev_row_mean_tex, vTexCoord.y);      //column1 previous frame pix
+            pix_texel = RowMean(prev_row_mean_tex, 2.0, vTexCoord.y);
         }
 
+        if (overlap_target ==1.0)
+            texel=pix_texel;
+        if (overlap_target == 2.0)
+            texel= (texel + pix_texel)/2.0;
 
+        texel -= vec4(dminmax.x);
+        texel *= vec4(1.0/(dminmax.y-dminmax.x));  // auto range based off of min and max values detected on current frame and apply to previous
 
-        texel = vec4(RGBToHSL(texel.xyz).z); //convert to luminance
+        texel = vec4(Lightness(texel)); //convert to luminance
 
     }
 
@@ -518,48 +528,84 @@ vTexRotated = vTexRotated +vec2(0.5,0.5);
         float max =0.0;
 
 
-        float prevs=(0.0);
-        float currs=(0.0);
-        texel=vec4(0.0);
-        for(int i =0 ; i<int(samp); i++) //shift i pixels then  sum differnces of 1d sound or sound & pix as previously rendered previous vs current
+        // outside the search area the error is the maximum (1.0); the
+        // comparison is only made inside it
+        if ((1.0- vTexCoord.y )> overlap.z+overlap.a+overlap.y ||
+                (1.0- vTexCoord.y )< overlap.a +overlap.z-overlap.y)
+            texel=vec4(1.0);
+        else
         {
-
-            prevs=((((( texture2D(overlap_audio_tex, vec2(0.25,(float(i)*sampstep)))))).x));
-            currs = ((((( texture2D(overlap_audio_tex, vec2(0.75,(float(i)*sampstep)+1.0-flip_coord.y))))).x));
-
-
-            if (float(i)*sampstep<1.0 && float(i)*sampstep>0.0 ) //is a legit on screen sample ?
+            float prevs=(0.0);
+            float currs=(0.0);
+            texel=vec4(0.0);
+            for(int i =0 ; i<int(samp); i++) //shift i pixels then  sum differnces of 1d sound or sound & pix as previously rendered previous vs current
             {
-                texel+= vec4(abs(prevs-currs));
-                realsamp++;
-            }
 
-        }
-        texel/= vec4(realsamp);  //if sampling goes off screen ignore value values
-
-        weighter = texel; // parabolic roll off of probablity working away from overlap calculated value
+                prevs=((((( texture2D(overlap_audio_tex, vec2(0.25,(float(i)*sampstep)))))).x));
+                currs = ((((( texture2D(overlap_audio_tex, vec2(0.75,(float(i)*sampstep)+1.0-flip_coord.y))))).x));
 
-        if ((1.0- vTexCoord.y )>= overlap.z+overlap.a-overlap.y && (1.0- vTexCoord.y )<=overlap.z+overlap.a)
-            weighter *= vec4(1.0)+ vec4(0.5*(1.0 - smoothstep(overlap.z+overlap.a-overlap.y,overlap.z+overlap.a,(1.0- vTexCoord.y ))));
-        if ((1.0- vTexCoord.y ) <= overlap.z+overlap.y+overlap.a && (1.0- vTexCoord.y )>=overlap.z+overlap.a)//
-            weighter *=  vec4(1.0)+vec4(0.5* smoothstep(overlap.z+overlap.a,overlap.z+overlap.a+overlap.y,(1.0- vTexCoord.y )));
 
-        texel = mix(texel,weighter,vec4(0.5));  //weight error by position
+                if (float(i)*sampstep<1.0 && float(i)*sampstep>0.0 ) //is a legit on screen sample ?
+                {
+                    texel+= vec4(abs(prevs-currs));
+                    realsamp++;
+                }
 
+            }
+            texel/= vec4(realsamp);  //if sampling goes off screen ignore value values
 
-        // if outside search area set error to max error( 1.0)
+            weighter = texel; // parabolic roll off of probablity working away from overlap calculated value
 
-        if ((1.0- vTexCoord.y )> overlap.z+overlap.a+overlap.y)
-            texel=vec4(1.0);
+            if ((1.0- vTexCoord.y )>= overlap.z+overlap.a-overlap.y && (1.0- vTexCoord.y )<=overlap.z+overlap.a)
+                weighter *= vec4(1.0)+ vec4(0.5*(1.0 - smoothstep(overlap.z+overlap.a-overlap.y,overlap.z+overlap.a,(1.0- vTexCoord.y ))));
+            if ((1.0- vTexCoord.y ) <= overlap.z+overlap.y+overlap.a && (1.0- vTexCoord.y )>=overlap.z+overlap.a)//
+                weighter *=  vec4(1.0)+vec4(0.5* smoothstep(overlap.z+overlap.a,overlap.z+overlap.a+overlap.y,(1.0- vTexCoord.y )));
 
-        if ((1.0- vTexCoord.y )< overlap.a +overlap.z-overlap.y)
-            texel=vec4(1.0);
+            texel = mix(texel,weighter,vec4(0.5));  //weight error by position
+        }
 
 
     }
 
 
 
+    if (render_mode==6.0) // minimum error of each overlap search window
+    {
+        // row: search window, texel: REDUCE_STEP (16) entries of the input.
+        // Output is (error, index, subsample), index -1 if none in range;
+        // ties go to the lowest index, as in OverlapSearch
+        float row = floor(gl_FragCoord.y);
+        float first = floor(gl_FragCoord.x)*16.0;
+        vec2 range = reduce_window[int(row)];
+        vec4 t;
+
+        texel = vec4(2.0, -1.0, 0.0, 0.0);
+        for(int k=0; k<16; k++)
+        {
+            float i = first + float(k);
+            if (reduce_controls.x==1.0)
+            {
+                if (i < range.x || i > range.y)
+                    continue;
+                t.x = OverlapError(i);
+                t.y = i;
+                t.z = 0.0;
+                if (i >= 1.0 && i <= reduce_controls.z-2.0) // positions count down
+                    t.z = -RefineMinimum(OverlapError(i-1.0), t.x, OverlapError(i+1.0));
+            }
+            else
+            {
+                if (i >= reduce_controls.y)
+                    break;
+                t = texture2D(reduce_tex, vec2((i+0.5)/reduce_controls.w, (row+0.5)/6.0));
+                if (t.y < 0.0)
+                    continue;
+            }
+            if (texel.y < 0.0 || t.x < texel.x || (t.x == texel.x && t.y < texel.y))
+                texel = t;
+        }
+    }
+
     if (render_mode==2.0) ////to screen picture render
     {
         texel = texture2D(adj_frame_tex, flip_coord    ); //adjusted picture
@@ -26,6 +26,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
 #include <QDebug>
 #include <QString>
 #include <QResource>
@@ -37,15 +38,7 @@
 //#include <qopengl.h>
 #include <math.h>
 #include <stdlib.h>
-
-#if defined(__clang__)
-# pragma clang diagnostic push
-# pragma clang diagnostic ignored "-Wunsequenced"
-#endif
-#include "DspFilters/Dsp.h"
-#if defined(__clang__)
-# pragma clang diagnostic pop
-#endif
+#include <string.h>
 
 #include "aeoexception.h"
 
@@ -240,8 +233,14 @@ Frame_Window::Frame_Window(int w,int h)
 
 	bestmatch.postion = 0;
 	bestmatch.value = 0;
+	bestmatch.subsample = 0;
 	currmatch.postion = 0;
 	currmatch.value = 0;
+	currmatch.subsample = 0;
+
+	fft_overlap = true;
+	track_pitch = false;
+	gpu_match = true;
 	match_array = new overlap_match[5];
 
 	cal_enabled=false;
@@ -271,8 +270,13 @@ Frame_Window::Frame_Window(int w,int h)
 
 	overlapshow=false;
 	is_rendering =false;
+	async_readback = true;
+	is_extracting = false;
+	preview_interval = 24;
 	is_debug = false;
 	overrideOverlap = 0;
+	fixed_overlap = false;
+	fixed_match = bestmatch;
 
 	fps = 24.0;
 	duration = 0; // milliseconds
@@ -293,7 +297,29 @@ Frame_Window::Frame_Window(int w,int h)
 	new_frame = false;
 
 	audio_draw_buffers = NULL;
-	audio_pbo = 0;
+	for(int i=0; i<AUDIO_PBO_RING; ++i)
+	{
+		audio_pbo[i] = 0;
+		audio_fence[i] = 0;
+		audio_pbo_dest[i][0] = audio_pbo_dest[i][1] = NULL;
+		audio_pbo_samples[i] = 0;
+	}
+	audio_pbo_next = 0;
+	video_pbo = 0;
+	video_pbo_pending = false;
+	sync_fun = NULL;
+	time_passes = false;
+	for(int i=0; i<GPU_TIMER_RING; ++i)
+	{
+		for(int p=0; p<GPU_PASSES; ++p)
+		{
+			pass_query[i][p] = NULL;
+			pass_pending[i][p] = false;
+		}
+	}
+	pass_slot = 0;
+	pass_active = -1;
+	ResetPassTimes();
 
 	m_posAttr = 0;
 	m_texAttr = 0;
@@ -314,6 +340,14 @@ Frame_Window::Frame_Window(int w,int h)
 	m_calcontrol_loc = 0;
 	m_overlapshow_loc = 0;
 	frame_texture = 0;
+	frame_tex_w = 0;
+	frame_tex_h = 0;
+	frame_tex_format = GL_RGB16;
+	has_tex_storage = false;
+	for(int i=0; i<FRAME_PBO_RING; ++i) frame_pbo[i] = 0;
+	frame_pbo_next = 0;
+	frame_pbo_size = 0;
+	frame_upload_map = NULL;
 	adj_frame_fbo = 0;
 	adj_frame_texture = 0;
 	prev_adj_frame_tex = 0;
@@ -327,6 +361,26 @@ Frame_Window::Frame_Window(int w,int h)
 	audio_float_texture = 0;
 	audio_int_texture = 0;
 	cal_audio_texture = 0;
+	tone_lut_texture = 0;
+	tone_lut_size = 0;
+	m_tonelut_loc = 0;
+	m_reduce_loc = 0;
+	m_reducewin_loc = 0;
+	reduce_fbo = 0;
+	reduce_texture[0] = reduce_texture[1] = 0;
+	reduce_width = 0;
+	m_rowcontrol_loc = 0;
+	row_fbo = 0;
+	row_texture[0] = row_texture[1] = 0;
+	row_mean_texture[0] = row_mean_texture[1] = 0;
+	m_batch_loc = 0;
+	batch_frames = 0;
+	batch_fbo = 0;
+	batch_frame_texture = 0;
+	batch_frame_format = 0;
+	batch_adj_texture = 0;
+	batch_row_texture[0] = batch_row_texture[1] = 0;
+	batch_mean_texture = 0;
 	vo.videobuffer=NULL;
 	is_videooutput=0;
 
@@ -339,6 +393,20 @@ Frame_Window::~Frame_Window()
 	CUR_OP("Deleting frame_texture");
 	glDeleteTextures(1,&frame_texture);
 
+	CUR_OP("Deleting frame upload buffers");
+	if(frame_upload_map)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER,frame_pbo[frame_pbo_next]);
+		#ifndef __APPLE__
+		OGL_Fun.
+		#endif
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+		frame_upload_map = NULL;
+	}
+	if(frame_upload.borrowed) frame_upload.buf = NULL; // not ours to delete
+	glDeleteBuffers(FRAME_PBO_RING,frame_pbo);
+
 	CUR_OP("Deleting adj_frame_fbo");
 	//glIsFramebuffer returns true, but glDeleteFrameBuffers crashes.
 	// Commenting this out to avoid the crash. It seems to not consume the
@@ -372,6 +440,26 @@ Frame_Window::~Frame_Window()
 	glDeleteTextures(1,&cal_audio_texture);
 	CUR_OP("Deleting output_audio_texture");
 	glDeleteTextures(1,&output_audio_texture);
+	CUR_OP("Deleting tone_lut_texture");
+	glDeleteTextures(1,&tone_lut_texture);
+	CUR_OP("Deleting reduce_texture");
+	glDeleteTextures(2,reduce_texture);
+	CUR_OP("Deleting row mean textures");
+	glDeleteTextures(2,row_texture);
+	glDeleteTextures(2,row_mean_texture);
+	CUR_OP("Deleting batch textures");
+	EndBatch();
+
+	CUR_OP("Deleting pass timers");
+	for(int i=0; i<GPU_TIMER_RING; ++i)
+		for(int p=0; p<GPU_PASSES; ++p)
+			delete pass_query[i][p];
+
+	CUR_OP("Deleting readback buffers");
+	for(int i=0; i<AUDIO_PBO_RING; ++i)
+		if(audio_fence[i]) sync_fun->glDeleteSync(audio_fence[i]);
+	glDeleteBuffers(AUDIO_PBO_RING,audio_pbo);
+	glDeleteBuffers(1,&video_pbo);
 
 	CHECK_GL_ERROR(__FILE__,__LINE__);
 
@@ -465,6 +553,12 @@ void Frame_Window::initialize()
 	dminmax_loc = m_program->uniformLocation("dminmax");
 	m_rendermode_loc = m_program->uniformLocation("render_mode");
 	m_overlap_loc = m_program->uniformLocation("overlap");
+	m_tonelut_loc = m_program->uniformLocation("tone_lut_coord");
+	m_luma_loc = m_program->uniformLocation("luma_input");
+	m_reduce_loc = m_program->uniformLocation("reduce_controls");
+	m_reducewin_loc = m_program->uniformLocation("reduce_window");
+	m_rowcontrol_loc = m_program->uniformLocation("row_controls");
+	m_batch_loc = m_program->uniformLocation("batch_frames");
 	gen_tex_bufs(); //call for all textures and buffers to be created
 	overlap[0]=0;
 	overlap[1]=0;
@@ -585,6 +679,20 @@ void Frame_Window::gen_tex_bufs()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	CHECK_GL_ERROR(__FILE__,__LINE__);
 
+	// tone curve lookup, filled in by UploadToneCurve()
+	glGenTextures(1,&tone_lut_texture);
+	glActiveTexture(GL_TEXTURE10);
+	glBindTexture(GL_TEXTURE_1D, tone_lut_texture);
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &tone_lut_size);
+	tone_lut_size = std::min(tone_lut_size, int(ToneCurve::SIZE));
+
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -593,6 +701,31 @@ void Frame_Window::gen_tex_bufs()
 
 	glActiveTexture(GL_TEXTURE0);
 
+	// pixel pack buffers for the file audio and video output readbacks,
+	// unpack buffers for the scan uploads
+	glGenBuffers(AUDIO_PBO_RING,audio_pbo);
+	glGenBuffers(1,&video_pbo);
+	glGenBuffers(FRAME_PBO_RING,frame_pbo);
+
+	QOpenGLContext *ctx = QOpenGLContext::currentContext();
+	if(ctx->hasExtension("GL_ARB_sync") ||
+			ctx->format().version() >= qMakePair(3,2))
+		sync_fun = ctx->extraFunctions();
+	has_tex_storage = ctx->hasExtension("GL_ARB_texture_storage") ||
+			ctx->format().version() >= qMakePair(4,2);
+
+	time_passes = ctx->hasExtension("GL_ARB_timer_query") ||
+			ctx->format().version() >= qMakePair(3,3);
+	for(int i=0; i<GPU_TIMER_RING && time_passes; ++i)
+	{
+		for(int p=0; p<GPU_PASSES && time_passes; ++p)
+		{
+			pass_query[i][p] = new QOpenGLTimerQuery;
+			time_passes = pass_query[i][p]->create();
+		}
+	}
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
 	GLint progactive;
 	glGetIntegerv(GL_CURRENT_PROGRAM, &progactive);
 	qDebug() << "Active program = " << progactive;
@@ -620,6 +753,16 @@ void Frame_Window::gen_tex_bufs()
 
 	texLoc =m_program->uniformLocation("cal_audio_tex");
 	glUniform1i(texLoc, 7); // GL Error: invalid operation
+	texLoc =m_program->uniformLocation("tone_lut_tex");
+	glUniform1i(texLoc, 10);
+	texLoc =m_program->uniformLocation("reduce_tex");
+	glUniform1i(texLoc, 11);
+	texLoc =m_program->uniformLocation("row_mean_tex");
+	glUniform1i(texLoc, 12);
+	texLoc =m_program->uniformLocation("prev_row_mean_tex");
+	glUniform1i(texLoc, 13);
+	texLoc =m_program->uniformLocation("row_tex");
+	glUniform1i(texLoc, 14);
 
 	CHECK_GL_ERROR(__FILE__,__LINE__);
 
@@ -684,6 +827,53 @@ void Frame_Window::gen_tex_bufs()
 	glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,
 			output_audio_texture,0);
 
+	// one row per overlap search window, REDUCE_STEP errors per texel
+	reduce_width = (samplesperframe + REDUCE_STEP-1) / REDUCE_STEP;
+	glGenTextures(2,reduce_texture);
+	glActiveTexture(GL_TEXTURE11);
+	for(int i=0; i<2; ++i)
+	{
+		glBindTexture(GL_TEXTURE_2D, reduce_texture[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,reduce_width,OVERLAP_WINDOWS,
+				0,GL_RGBA,GL_FLOAT,NULL);
+	}
+	glGenFramebuffers(1,&reduce_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER,reduce_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,
+			reduce_texture[0],0);
+
+	// row means of the adjusted frames: ROW_SEGMENTS per range while
+	// reducing, one column per range when done
+	glGenTextures(2,row_texture);
+	glActiveTexture(GL_TEXTURE14);
+	for(int i=0; i<2; ++i)
+	{
+		glBindTexture(GL_TEXTURE_2D, row_texture[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,3*ROW_SEGMENTS,input_h,0,
+				GL_RGBA,GL_FLOAT,NULL);
+	}
+	glGenTextures(2,row_mean_texture);
+	for(int i=0; i<2; ++i)
+	{
+		glActiveTexture(GL_TEXTURE12+i);
+		glBindTexture(GL_TEXTURE_2D, row_mean_texture[i]);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,3,input_h,0,
+				GL_RGBA,GL_FLOAT,NULL);
+	}
+	glGenFramebuffers(1,&row_fbo);
+
 	glActiveTexture(GL_TEXTURE0);
 
 	CHECK_GL_ERROR(__FILE__,__LINE__);
@@ -691,28 +881,157 @@ void Frame_Window::gen_tex_bufs()
 	glDisable(GL_DEPTH_TEST);
 }
 
-void Frame_Window::load_frame_texture(FrameTexture *frame)
+// bytes of image data in a decoded frame
+static size_t FrameBytes(const FrameTexture *frame)
+{
+	size_t pixels = size_t(frame->width) * frame->height;
+
+	switch(frame->format)
+	{
+	case GL_UNSIGNED_INT_10_10_10_2: return pixels * 4;
+	case GL_UNSIGNED_BYTE: return pixels * frame->nComponents;
+	default: return pixels * frame->nComponents * 2;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// The frame texture storage is allocated once per frame size and format
+// (immutable where supported, which means a new texture object if either
+// changes) and each frame is copied in with glTexSubImage2D. Single channel
+// frames go to an R16 texture and the shader reads its red channel as
+// lightness. A frame decoded into MapFrameBuffer() is uploaded from its
+// unpack buffer, so the copy to the GPU runs asynchronously; any other
+// frame, or one too large for the buffer, is copied from client memory.
+
+void Frame_Window::AllocateFrameTexture(int width, int height,
+		GLenum internalformat)
 {
-	GLenum componentformat;
-	CHECK_GL_ERROR(__FILE__,__LINE__);
 	glActiveTexture(GL_TEXTURE0);
-	glPixelStorei(GL_UNPACK_SWAP_BYTES, frame->isNonNativeEndianess) ;
-	glBindTexture(GL_TEXTURE_2D,frame_texture);
+
+	if(has_tex_storage && frame_tex_w)
+	{
+		// immutable storage cannot be resized
+		glDeleteTextures(1,&frame_texture);
+		glGenTextures(1,&frame_texture);
+		glBindTexture(GL_TEXTURE_2D, frame_texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	}
+	else
+		glBindTexture(GL_TEXTURE_2D, frame_texture);
+
+	if(has_tex_storage)
+	{
+		QOpenGLContext::currentContext()->extraFunctions()->glTexStorage2D(
+				GL_TEXTURE_2D, 1, internalformat, width, height);
+	}
+	else
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, internalformat, width, height, 0,
+				internalformat==GL_R16 ? GL_RED : GL_RGB, GL_UNSIGNED_SHORT,
+				NULL);
+	}
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	frame_tex_w = width;
+	frame_tex_h = height;
+	frame_tex_format = internalformat;
+}
+
+FrameTexture *Frame_Window::MapFrameBuffer()
+{
+	// still mapped if the last decode failed
+	if(frame_upload_map) return &frame_upload;
+
+	if(frame_pbo_size == 0 || frame_pbo[0] == 0) return NULL;
+	if(!makeContextCurrent()) return NULL;
+
+	// orphan the old contents so mapping does not wait for their upload
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER,frame_pbo[frame_pbo_next]);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER,frame_pbo_size,NULL,GL_STREAM_DRAW);
+	frame_upload_map = static_cast<uint8_t *>(
+			#ifndef __APPLE__
+			OGL_Fun.
+			#endif
+			glMapBuffer(GL_PIXEL_UNPACK_BUFFER,GL_WRITE_ONLY));
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
 	CHECK_GL_ERROR(__FILE__,__LINE__);
 
+	if(frame_upload_map == NULL) return NULL;
+
+	// the decoders write no more than bufSize into it
+	frame_upload.buf = frame_upload_map;
+	frame_upload.bufSize = int(frame_pbo_size);
+	frame_upload.borrowed = true;
+	return &frame_upload;
+}
+
+void Frame_Window::load_frame_texture(FrameTexture *frame)
+{
+	GLenum internalformat = (frame->nComponents == 1) ? GL_R16 : GL_RGB16;
+
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	if(frame->width != frame_tex_w || frame->height != frame_tex_h ||
+			internalformat != frame_tex_format)
+		AllocateFrameTexture(frame->width, frame->height, internalformat);
+
+	UploadFrame(frame, frame_texture, 0);
+	new_frame=true;
+}
+
+// Copy a frame into rows yoffset and up of a texture that has room for it
+void Frame_Window::UploadFrame(FrameTexture *frame, GLuint texture,
+		int yoffset)
+{
+	GLenum componentformat;
+	bool mapped = (frame == &frame_upload);
+	// a frame too large for the unpack buffer was decoded into memory of
+	// its own instead, and is copied from there
+	bool unpack = mapped && frame->buf == frame_upload_map;
+
 	switch(frame->nComponents)
 	{
 	case 4: componentformat = GL_RGBA; break;
 	case 3:	componentformat = GL_RGB; break;
-	case 1:	componentformat = GL_LUMINANCE; break;
+	case 1:	componentformat = GL_RED; break;
 	default: throw AeoException("Invalid num_components");
 	}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16, frame->width, frame->height, 0,
-			componentformat, frame->format, frame->buf);
+	if(mapped)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER,frame_pbo[frame_pbo_next]);
+		#ifndef __APPLE__
+		OGL_Fun.
+		#endif
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		frame_upload_map = NULL;
+		frame_pbo_next = (frame_pbo_next+1) % FRAME_PBO_RING;
+		if(!unpack) glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glPixelStorei(GL_UNPACK_SWAP_BYTES, frame->isNonNativeEndianess) ;
+	glBindTexture(GL_TEXTURE_2D,texture);
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, yoffset, frame->width, frame->height,
+			componentformat, frame->format, unpack ? NULL : frame->buf);
+
+	if(unpack) glBindBuffer(GL_PIXEL_UNPACK_BUFFER,0);
+	if(mapped)
+	{
+		if(!frame_upload.borrowed) delete [] frame_upload.buf;
+		frame_upload.buf = NULL;
+	}
+	if(texture != frame_texture) glBindTexture(GL_TEXTURE_2D,frame_texture);
+
+	// later frames of the source can be decoded into an unpack buffer
+	frame_pbo_size = std::max(frame_pbo_size, FrameBytes(frame));
 
 	CHECK_GL_ERROR(__FILE__,__LINE__);
-	new_frame=true;
 }
 
 void Frame_Window::update_parameters()
@@ -735,6 +1054,8 @@ void Frame_Window::update_parameters()
 	m_program->setUniformValue(m_overlapshow_loc, float(overlapshow));
 	m_program->setUniformValue(m_inputsize_loc, float(input_w), float(input_h));
 	m_program->setUniformValue(m_overlap_target_loc, overlap_target);
+	m_program->setUniformValue(m_luma_loc, float(frame_tex_format == GL_R16));
+	m_program->setUniformValue(m_batch_loc, 1.0f, 1.0f);
 }
 
 void Frame_Window::CopyFrameBuffer(GLuint fbo, int width, int height)
@@ -758,6 +1079,46 @@ void Frame_Window::CopyFrameBuffer(GLuint fbo, int width, int height)
 	glDrawBuffer(0);
 }
 
+//-----------------------------------------------------------------------------
+// Copy the tone curve tables into tone_lut_texture. The texture may be
+// shorter than the 64K table if GL_MAX_TEXTURE_SIZE is smaller; linear
+// filtering between entries covers the difference.
+
+void Frame_Window::UploadToneCurve()
+{
+	int n = tone_lut_size;
+	std::vector<float> lut(3*n);
+
+	for(int i=0; i<n; ++i)
+	{
+		float x = float(i)/(n-1);
+		int j = int(x*(ToneCurve::SIZE-1) + 0.5f);
+		if(n == ToneCurve::SIZE)
+		{
+			lut[3*i+0] = toneCurve.Curve()[j];
+			lut[3*i+1] = toneCurve.Levels()[j];
+			lut[3*i+2] = toneCurve.SCurve()[j];
+		}
+		else
+		{
+			lut[3*i+0] = toneCurve.Lookup(x);
+			lut[3*i+1] = toneCurve.Levels()[j];
+			lut[3*i+2] = toneCurve.SCurve()[j];
+		}
+	}
+
+	glActiveTexture(GL_TEXTURE10);
+	glBindTexture(GL_TEXTURE_1D, tone_lut_texture);
+	glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_FALSE);
+	glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB32F, n, 0, GL_RGB, GL_FLOAT,
+			&lut[0]);
+	glActiveTexture(GL_TEXTURE0);
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	// map 0-1 onto the centres of the first and last texels
+	m_program->setUniformValue(m_tonelut_loc, float(n-1)/n, 0.5f/n);
+}
+
 void Frame_Window::render()
 {
 
@@ -771,6 +1132,15 @@ void Frame_Window::render()
 	m_program->setUniformValue("overlap_audio_tex",5);
 	m_program->setUniformValue("overlapcompute_audio_tex",6);
 	m_program->setUniformValue("cal_audio_tex",7);
+	m_program->setUniformValue("tone_lut_tex",10);
+	m_program->setUniformValue("reduce_tex",11);
+	m_program->setUniformValue("row_mean_tex",12);
+	m_program->setUniformValue("prev_row_mean_tex",13);
+	m_program->setUniformValue("row_tex",14);
+
+	CUR_OP("updating tone curve");
+	if(toneCurve.Update(negative, lift, gamma, gain, thresh, threshold))
+		UploadToneCurve();
 
 	const qreal retinaScale = devicePixelRatio();
 
@@ -860,7 +1230,14 @@ void Frame_Window::render()
 
 	bool jitteractive = false;
 
+	// While extracting, the display passes (mode 1, 2 and 3) only run for
+	// a preview every preview_interval frames, and calibration not at all.
+	bool preview = !is_extracting ||
+			(preview_interval > 0 && m_frame % preview_interval == 0);
+
 	CUR_OP("adjustment render (mode 0)");
+	NextPassFrame();
+	BeginPass(PASS_ADJUST);
 	m_program->setUniformValue(m_rendermode_loc, 0.0f);
 
 	CUR_OP("new frame vertext attrib pointed to verticesTex");
@@ -883,51 +1260,57 @@ void Frame_Window::render()
 	CHECK_GL_ERROR(__FILE__,__LINE__);
 
 
+	//******************************Row means**********************************
+	// Input Textures: adj_frame_texture and prev_adj_frame_texture
+	// Renders to: row_mean_texture
+	// Description: mean of each row over the track halves and the picture
+	//   bounds, which is all modes 1, 1.5 and 4 sample
+
+	BeginPass(PASS_ROW_MEANS);
+	RowMeans(indices, input_h, row_texture, row_mean_texture, 2);
+	EndPass();
+
 	//********************************Audio RENDER*****************************
 	// Input Textures: adj_frame_texture (adjusted image texture)
 	// Renders to: audio_RGB_texture
 	// Description: steps through each line within x boundary and computes
 	//   value for display
 
-	CUR_OP("audio render (mode 1)");
-	m_program->setUniformValue(m_rendermode_loc, 1.0f);
-	CUR_OP("setting vertexSttribPointer for audio render");
-	glVertexAttribPointer(m_texAttr, 3, GL_FLOAT, GL_FALSE, 0, verticesTex);
-	CHECK_GL_ERROR(__FILE__,__LINE__);
-	CUR_OP("binding to audio_fbo in mode 1");
-	glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
-	glDrawBuffer(GL_COLOR_ATTACHMENT0);
-	glViewport(0,0, 2, samplesperframe);
-
-	glClear(GL_COLOR_BUFFER_BIT);
-
-	CUR_OP("drawElements for audio_fbo in mode 1");
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
-
+	// The display range is fixed, so the result is not read back.
+	float dmin =0.0;
+	float dmax =1.0;
+	m_program->setUniformValue(dminmax_loc, dmin,dmax);
 
-	CHECK_GL_ERROR(__FILE__,__LINE__);
-	glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
-	glReadBuffer(GL_COLOR_ATTACHMENT0);
-	CHECK_GL_ERROR(__FILE__,__LINE__);
+	if(preview)
+	{
+		CUR_OP("audio render (mode 1)");
+		BeginPass(PASS_AUDIO);
+		m_program->setUniformValue(m_rendermode_loc, 1.0f);
+		CUR_OP("setting vertexSttribPointer for audio render");
+		glVertexAttribPointer(m_texAttr, 3, GL_FLOAT, GL_FALSE, 0,
+				verticesTex);
+		CHECK_GL_ERROR(__FILE__,__LINE__);
+		CUR_OP("binding to audio_fbo in mode 1");
+		glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		glViewport(0,0, 2, samplesperframe);
 
-	//copy float buffer out
-	CUR_OP("copy float buffer out of audio_fbo in mode 1");
-	glReadPixels(0,0,2,samplesperframe,GL_RED, GL_FLOAT,audio_compare_buffer);
-	fullarray = (static_cast<GLfloat*>(audio_compare_buffer));
+		glClear(GL_COLOR_BUFFER_BIT);
 
-	CUR_OP("getting dmin and dmax from audio_fbo in mode 1");
-	GLfloat* subdminarray = &fullarray[samplesperframe-samplesperframe/4];
-	float dmin =0.0;// GetMin(subdminarray,samplesperframe/4);
-	float dmax =1.0;// GetMax(subdminarray,samplesperframe/4);
-	m_program->setUniformValue(dminmax_loc, dmin,dmax);
+		CUR_OP("drawElements for audio_fbo in mode 1");
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
+		CHECK_GL_ERROR(__FILE__,__LINE__);
+		EndPass();
+	}
 
 	//**********************************Cal RENDER*****************************
 	// Input Textures: adj_frame_texture (adjusted image texture)
 	// Renders to: cal_audio_texture
 	// Description: averages lines with alpha 0.005 200 frames
-	if(is_caling)
+	if(is_caling && !is_extracting)
 	{
 		CUR_OP("Cal Render");
+		BeginPass(PASS_CAL);
 
 		m_program->setUniformValue(m_rendermode_loc, 1.0f);
 		glVertexAttribPointer(m_texAttr, 3, GL_FLOAT, GL_FALSE, 0, verticesTRO);
@@ -957,134 +1340,144 @@ void Frame_Window::render()
 		glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
 		glReadBuffer(GL_COLOR_ATTACHMENT0);
 		CHECK_GL_ERROR(__FILE__,__LINE__);
+		EndPass();
 	}
-	//**************** RENDER Audio & Pix for Overlap for computations*********
-	// x0 = curr *** x1 =prev
-	// Input Textures: adj_frame_texture (adjusted image texture)
-	//   and prev_adj_frame_texture
-	// Renders to: overlap_compare_audio_texture
-	// Description: computes 1d waveform for current and previous adjusted
-	//   frames. pixel column 0 is current and column 1 is previous
-
-	CUR_OP("Audio overlap render (mode 4)");
-	m_program->setUniformValue(m_rendermode_loc, 4.0f);
-	CUR_OP("Set VertextAttribPointer for Audio overlap render (mode 4)");
-	glVertexAttribPointer(m_texAttr, 3, GL_FLOAT, GL_FALSE, 0, verticesTex);
-	CHECK_GL_ERROR(__FILE__,__LINE__);
-	CUR_OP("Binding audio_fbo for Audio overlap render (mode 4)");
-	glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
-	glDrawBuffer(GL_COLOR_ATTACHMENT2);
-	glViewport(0,0, 2, samplesperframe);
-	glClear(GL_COLOR_BUFFER_BIT);
-	CUR_OP("Drawing elements for Audio overlap render (mode 4)");
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
-	CHECK_GL_ERROR(__FILE__,__LINE__);
-	glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
-
-	//****************************overlap renders *****************************
-	// Input Textures: overlap_compare_audio_texture
-	// Renders to: overlaps_audio_texture
-	// Description: slides curr and previous 1d arrays over each other and
-	// takes the absolute value difference
-	//  location is 2 * tex coord
-
-	CUR_OP("Drawing overlaps (mode 5)");
-	m_program->setUniformValue(m_rendermode_loc, 5.0f);
-	CUR_OP("Set vertexAttribPointer for Drawing overlaps (mode 5)");
-	glVertexAttribPointer(m_texAttr, 3, GL_FLOAT, GL_FALSE, 0, verticesTex);
-	CHECK_GL_ERROR(__FILE__,__LINE__);
-	CUR_OP("binding audio_fbo for Drawing overlaps (mode 5)");
-	glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
-
-	glDrawBuffer(GL_COLOR_ATTACHMENT3);
-
-	glViewport(0,0, 2, samplesperframe);
-
-	glClear(GL_COLOR_BUFFER_BIT);
-
-	//  glBindTexture(GL_TEXTURE_2D,adj_frame_texture);
-
-	CUR_OP("drawing elements for Drawing overlaps (mode 5)");
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
-	CHECK_GL_ERROR(__FILE__,__LINE__);
-
-	glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
-	glReadBuffer(GL_COLOR_ATTACHMENT3);
-	CUR_OP("reading pixels for audio_compare_buffer");
-	glReadPixels(0,0,1,samplesperframe,GL_RED, GL_FLOAT,audio_compare_buffer);
-	CHECK_GL_ERROR(__FILE__,__LINE__);
 
-	//***********************Find best overlap match***************************
-	float low=20.0;
-	float temp;
 	lowloc=0;
-	// for (int i = 4; i<2*(samplesperframe * overlap[1]); i++)
-
-	int start ;
-	int end ;
-	int pitchline;
-	int lowest;
-	fullarray = (static_cast<GLfloat*>(audio_compare_buffer));
-
-	CUR_OP("setting search parameters for finding best overlap");
-	// end = std::max(end,start);
+	int start = 0;
+	int end = 0;
 	bool outsidefind = false;
-	start = (overlap[2]+overlap[3]) * samplesperframe -
-			(overlap[1]*0.5*samplesperframe) ;
-	end = (overlap[2]+overlap[3]) * samplesperframe +
-			(overlap[1]*0.5*samplesperframe) ;
-	pitchline = (overlap[2]+overlap[3]) * samplesperframe;
-
-	start = std::max(4,start);
-	end = std::min(end,1998);
-	end=std::max(end,start);
-	pitchline = (end+start)/2;
-
-	GLfloat* subarray = &fullarray[samplesperframe-end];
 
-	CUR_OP("getting best match from subarray in finding best overlap");
-	GetBestMatchFromFloatArray(subarray,(end-start),end, bestmatch);
-
-	int s_start,s_end;
-	int s_size = end-start;
-	int s_mid = start + (s_size/2);
-	int s_i_size;
-	int best=0;
-
-	for (int i = 1; i<6; i++)
+	// a stored overlap map gives the overlap of this frame: the profiles
+	// are not rendered and nothing is searched
+	if(fixed_overlap)
+		bestmatch = fixed_match;
+	else
 	{
-		s_i_size =  ((s_size/2)/5);
-		if(i==1)
+		//**************** RENDER Audio & Pix for Overlap for computations*******
+		// x0 = curr *** x1 =prev
+		// Input Textures: adj_frame_texture (adjusted image texture)
+		//   and prev_adj_frame_texture
+		// Renders to: overlap_compare_audio_texture
+		// Description: computes 1d waveform for current and previous adjusted
+		//   frames. pixel column 0 is current and column 1 is previous
+
+		CUR_OP("Audio overlap render (mode 4)");
+		BeginPass(PASS_PROFILE);
+		m_program->setUniformValue(m_rendermode_loc, 4.0f);
+		CUR_OP("Set VertextAttribPointer for Audio overlap render (mode 4)");
+		glVertexAttribPointer(m_texAttr, 3, GL_FLOAT, GL_FALSE, 0, verticesTex);
+		CHECK_GL_ERROR(__FILE__,__LINE__);
+		CUR_OP("Binding audio_fbo for Audio overlap render (mode 4)");
+		glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
+		glDrawBuffer(GL_COLOR_ATTACHMENT2);
+		glViewport(0,0, 2, samplesperframe);
+		glClear(GL_COLOR_BUFFER_BIT);
+		CUR_OP("Drawing elements for Audio overlap render (mode 4)");
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
+		CHECK_GL_ERROR(__FILE__,__LINE__);
+		glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
+
+		//****************************overlap renders ***************************
+		// Input Textures: overlap_compare_audio_texture
+		// Renders to: overlaps_audio_texture
+		// Description: slides curr and previous 1d arrays over each other and
+		// takes the absolute value difference
+		//  location is 2 * tex coord
+		//  offsets outside the search window are not compared; the window
+		//  is the whole one set by the overlap controls, pitch tracking does
+		//  not narrow it
+		//
+		// With fft_overlap the two 1d arrays are read back instead and the
+		// error for every offset is computed on the CPU by cross-correlation,
+		// which finds the best match too; with track_pitch only the offsets
+		// near where the last frames lead are compared. The result is
+		// uploaded to overlaps_audio_texture for the display.
+
+		BeginPass(PASS_OVERLAP);
+		if(fft_overlap)
 		{
-			s_start = s_mid -(4);
-			s_end   = s_mid +(4);
+			CUR_OP("reading overlap profiles for FFT overlap search");
+			glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
+			glReadBuffer(GL_COLOR_ATTACHMENT2);
+			glReadPixels(0,0,2,samplesperframe,GL_RED,GL_FLOAT,
+					audio_compare_buffer);
+			CHECK_GL_ERROR(__FILE__,__LINE__);
+
+			sound_curr.resize(samplesperframe);
+			sound_prev.resize(samplesperframe);
+			for(int i=0; i<samplesperframe; ++i)
+			{
+				sound_curr[i] = audio_compare_buffer[2*i];
+				sound_prev[i] = audio_compare_buffer[2*i+1];
+			}
 
+			CUR_OP("FFT overlap search");
+			// renders for the display leave the history alone
+			if(is_extracting && !track_pitch) overlapSearch.ResetTracking();
+			overlapSearch.Search(&sound_curr[0], &sound_prev[0],
+					samplesperframe, overlap, is_calc,
+					is_extracting && track_pitch, audio_compare_buffer,
+					bestmatch, match_array, start, end);
+
+			CUR_OP("uploading FFT overlap errors");
+			glActiveTexture(GL_TEXTURE6);
+			glBindTexture(GL_TEXTURE_2D,overlaps_audio_texture);
+			glPixelStorei(GL_UNPACK_SWAP_BYTES, GL_FALSE);
+			glTexSubImage2D(GL_TEXTURE_2D,0,0,0,1,samplesperframe,GL_RED,
+					GL_FLOAT,audio_compare_buffer);
+			glActiveTexture(GL_TEXTURE0);
+			CHECK_GL_ERROR(__FILE__,__LINE__);
 		}
 		else
 		{
-			s_start = s_mid -(s_i_size*i);
-			s_end   = s_mid +(s_i_size*i);
-		}
+			CUR_OP("Drawing overlaps (mode 5)");
+			m_program->setUniformValue(m_rendermode_loc, 5.0f);
+			CUR_OP("Set vertexAttribPointer for Drawing overlaps (mode 5)");
+			glVertexAttribPointer(m_texAttr, 3, GL_FLOAT, GL_FALSE, 0,
+					verticesTex);
+			CHECK_GL_ERROR(__FILE__,__LINE__);
+			CUR_OP("binding audio_fbo for Drawing overlaps (mode 5)");
+			glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
 
-		s_start= std::max(4,s_start);
-		s_end = std::min(s_end,1998);
+			glDrawBuffer(GL_COLOR_ATTACHMENT3);
 
-		subarray = &fullarray[samplesperframe-s_end];
+			glViewport(0,0, 2, samplesperframe);
 
-		CUR_OP("getting best match 2 from subarray in finding best overlap");
-		GetBestMatchFromFloatArray(subarray,(s_end-s_start),s_end,
-				match_array[i-1]) ;
-	}
-	if(is_calc)
-	{
-		bestmatch= match_array[0];
-	}
+			glClear(GL_COLOR_BUFFER_BIT);
 
-	else
-		bestmatch= match_array[4];
+			//  glBindTexture(GL_TEXTURE_2D,adj_frame_texture);
+
+			CUR_OP("drawing elements for Drawing overlaps (mode 5)");
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
+			CHECK_GL_ERROR(__FILE__,__LINE__);
+
+			if(!gpu_match)
+			{
+				glBindFramebuffer(GL_FRAMEBUFFER,audio_fbo);
+				glReadBuffer(GL_COLOR_ATTACHMENT3);
+				CUR_OP("reading pixels for audio_compare_buffer");
+				glReadPixels(0,0,1,samplesperframe,GL_RED, GL_FLOAT,
+						audio_compare_buffer);
+				CHECK_GL_ERROR(__FILE__,__LINE__);
+			}
+		}
+
+		//***********************Find best overlap match*************************
+		fullarray = (static_cast<GLfloat*>(audio_compare_buffer));
+
+		CUR_OP("getting best match in finding best overlap");
+		if(!fft_overlap && !gpu_match)
+			OverlapSearch::FindBestMatch(fullarray, samplesperframe, overlap,
+					is_calc, bestmatch, match_array, start, end);
+		else if(!fft_overlap)
+			GpuBestMatch(indices, start, end);
+		EndPass();
+	}
+	int s_mid = start + (end-start)/2;
 
 	CUR_OP("recording best overlap");
-	overlap[0] = (float)(bestmatch.postion)/2000.0;
+	overlap[0] = ((float)(bestmatch.postion)+bestmatch.subsample)/2000.0;
 
 	bool usegl=true;
 
@@ -1133,6 +1526,7 @@ void Frame_Window::render()
     if(is_videooutput)
     {
         CUR_OP("screen render (mode 2)");
+        BeginPass(PASS_VIDEO);
         m_program->setUniformValue(m_rendermode_loc, 0.0f);
         CUR_OP("setting vertexAttribPointer for screen render (mode 2)");
 
@@ -1151,15 +1545,32 @@ void Frame_Window::render()
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
         CHECK_GL_ERROR(__FILE__,__LINE__);
 
+        // start the readback now; read_frame_texture() collects it after
+        // the audio passes
+        if(vo.videobuffer != NULL)
+        {
+            CUR_OP("queueing video output readback");
+            glReadBuffer(GL_COLOR_ATTACHMENT0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER,video_pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER,vo.width*vo.height*4,NULL,
+                    GL_STREAM_READ);
+            glReadPixels(0, 0, vo.width, vo.height,GL_RGBA,
+                    GL_UNSIGNED_INT_8_8_8_8_REV, 0);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+            CHECK_GL_ERROR(__FILE__,__LINE__);
+            video_pbo_pending = true;
+        }
+        EndPass();
     }
 	//**********************Pix to screen render*******************************
 	// Input Textures: picture textures
 	// Renders to: screen back buffer
 	// Description: display picture
 
-	if(!is_calculating)
+	if(!is_calculating && !isOffscreen() && preview)
 	{
 		CUR_OP("screen render (mode 2)");
+		BeginPass(PASS_SCREEN);
 		m_program->setUniformValue(m_rendermode_loc, 2.0f);
 		CUR_OP("setting vertexAttribPointer for screen render (mode 2)");
 		if(trackonly)
@@ -1203,14 +1614,17 @@ void Frame_Window::render()
 		CUR_OP("drawing elements for soundwaveform render (mode 3)");
 		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
 		CHECK_GL_ERROR(__FILE__,__LINE__);
+		EndPass();
 	}
+	else
+		m_skip_swap = true;
 
 	//*************************************************************************
 	// Overlap Compute with new coordinates
 	CUR_OP("overlap computer with new coordinates");
 	float bestvalue = 1.0f+(overlap[3] - ((float)(bestloc)/2000.0));
-	float bestvalueoffset =
-			1.0f+(overlap[3] - ((float)(bestmatch.postion)/2000.0));
+	float bestvalueoffset = 1.0f+(overlap[3] - ((float)(bestmatch.postion)+
+			bestmatch.subsample)/2000.0);
 
 	GLfloat verticesTRO_ForFile[] ={
 		bounds[0], overlap[3], 0, // bottom left corner
@@ -1226,6 +1640,7 @@ void Frame_Window::render()
 	//   calculated space.
 
 	CUR_OP("audio render for file (mode 1.5)");
+	BeginPass(PASS_FILE_AUDIO);
 	m_program->setUniformValue(m_rendermode_loc, 1.5f);
 	CUR_OP("set vertexAttribPointer  for audio render for file (mode 1.5)");
 	glVertexAttribPointer(m_texAttr, 3, GL_FLOAT, GL_FALSE, 0,
@@ -1250,7 +1665,17 @@ void Frame_Window::render()
 
 	// is_rendering = recording to filebuffer
 	// new_frame indicates a frame texture was loaded
-	if (is_rendering && new_frame )
+	// The muxer reads the samples as soon as the frame is loaded, so
+	// with video output they are read back synchronously.
+	if (is_rendering && new_frame && async_readback && !is_videooutput)
+	{
+		CUR_OP("queueing readback for audio render for file (mode 1.5)");
+		QueueAudioReadback(&FileRealBuffer[0][samplepointer],
+				&FileRealBuffer[1][samplepointer], samplesperframe_file);
+
+		samplepointer+=samplesperframe_file;
+	}
+	else if (is_rendering && new_frame )
 	{
 		CUR_OP("reading left channel for audio render for file (mode 1.5)");
 		//copy float buffer out for file left channel
@@ -1265,6 +1690,7 @@ void Frame_Window::render()
 		samplepointer+=samplesperframe_file;
 	}
 	CHECK_GL_ERROR(__FILE__,__LINE__);
+	EndPass();
 
 	CUR_OP("binding fbo 0 for audio render for file (mode 1.5)");
 	glBindFramebuffer(GL_FRAMEBUFFER,0);
@@ -1285,72 +1711,56 @@ void Frame_Window::render()
 	new_frame=false;
 }
 
-void Frame_Window::PrepareRecording(int numsamples)
+void Frame_Window::SetRecordingBuffer(float **buf, int pos)
 {
-	FileRealBuffer= new float* [2];
-
-	FileRealBuffer[0] = new float[numsamples];
-	FileRealBuffer[1] = new float[numsamples];
-
-	if(logger)
-	{
-		(*logger) << "FileRealBuffer = [" << FileRealBuffer[0] <<
-				"," << FileRealBuffer[1] << "] (2x" << numsamples << "\n";
-	}
-	fprintf(stderr, "FileRealBuffer = [%p,%p]\n",
-			FileRealBuffer[0], FileRealBuffer[1]);
-	fflush(stderr);
-
-	samplepointer=0;
+	FileRealBuffer = buf;
+	samplepointer = buf ? pos : 0;
 }
 
-void Frame_Window::DestroyRecording()
+ExtractionParameters Frame_Window::Parameters() const
 {
-	delete [] FileRealBuffer[1];
-	delete [] FileRealBuffer[0];
-
-	delete[] FileRealBuffer ;
-	FileRealBuffer = NULL;
-	samplepointer=0;
+	ExtractionParameters p;
+
+	p.lift = lift;
+	p.gamma = gamma;
+	p.gain = gain;
+	p.threshold = threshold;
+	p.blur = blur;
+	p.stereo = stereo;
+	p.thresh = thresh;
+	p.negative = negative;
+	p.cal_enabled = cal_enabled;
+	p.is_calc = is_calc;
+	p.overlap_target = overlap_target;
+	for(int i=0; i<4; ++i) p.bounds[i] = bounds[i];
+	for(int i=0; i<4; ++i) p.overlap[i] = overlap[i];
+	p.pixbounds[0] = pixbounds[0];
+	p.pixbounds[1] = pixbounds[1];
+	p.rot_angle = rot_angle;
+
+	return p;
 }
 
-void Frame_Window::ProcessRecording(int numsamples)
+void Frame_Window::SetParameters(const ExtractionParameters &p)
 {
-	Dsp::Filter* fh =
-			new Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::LowPass, 2> (1024);
-	Dsp::Params hparams;
-	hparams[0] = 48000; // sample rate
-	hparams[1] = 13500; // cutoff frequency
-	hparams[2] = 4.5; // Q
-	fh->setParams (hparams);
-	fh->process (numsamples,( FileRealBuffer));
-
-	delete fh;
-
-	Dsp::Filter* fl =
-			new Dsp::SmoothedFilterDesign<Dsp::RBJ::Design::HighPass, 2> (1024);
-	Dsp::Params lparams;
-	lparams[0] = 48000; // sample rate
-	lparams[1] = 50; // cutoff frequency
-	lparams[2] = 1.5; // Q
-	fl->setParams (lparams);
-	fl->process (numsamples,( FileRealBuffer));
-
-	delete fl;
-
-	if (stereo == 2.0) //push pull
-	{
-		float phasefixed;
-		for (int i = 0; i< numsamples; i++)
-		{
-			phasefixed =  ( FileRealBuffer[0][i]-FileRealBuffer[1][i]) /2.0;
-			FileRealBuffer[1][i]=phasefixed;
-			FileRealBuffer[0][i]=phasefixed;
-		}
-	}
-
-
+	lift = p.lift;
+	gamma = p.gamma;
+	gain = p.gain;
+	threshold = p.threshold;
+	blur = p.blur;
+	stereo = p.stereo;
+	thresh = p.thresh;
+	negative = p.negative;
+	cal_enabled = p.cal_enabled;
+	is_calc = p.is_calc;
+	overlap_target = p.overlap_target;
+	for(int i=0; i<4; ++i) bounds[i] = p.bounds[i];
+	for(int i=0; i<4; ++i) overlap[i] = p.overlap[i];
+	pixbounds[0] = p.pixbounds[0];
+	pixbounds[1] = p.pixbounds[1];
+	rot_angle = p.rot_angle;
 }
+
 void Frame_Window::PrepareVideoOutput(FrameTexture * frame)
 {
 	if(vo.video_output_fbo!=0)
@@ -1393,6 +1803,31 @@ void Frame_Window::read_frame_texture(FrameTexture * frame)
 {
 	if(vo.videobuffer == NULL) return;
 
+	if(video_pbo_pending)
+	{
+		video_pbo_pending = false;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,video_pbo);
+		const void *p =
+				#ifndef __APPLE__
+				OGL_Fun.
+				#endif
+				glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY);
+		if(p)
+		{
+			memcpy(vo.videobuffer, p, size_t(vo.width)*vo.height*4);
+			#ifndef __APPLE__
+			OGL_Fun.
+			#endif
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+			return;
+		}
+
+		// could not map: fall back to reading the FBO again
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+	}
+
 	glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
 
 	//  glPixelStorei(GL_UNPACK_SWAP_BYTES,0);
@@ -1407,6 +1842,120 @@ void Frame_Window::read_frame_texture(FrameTexture * frame)
 			GL_UNSIGNED_INT_8_8_8_8_REV, vo.videobuffer); //copy buffer out to
 }
 
+//-----------------------------------------------------------------------------
+// Asynchronous readback of the file audio. QueueAudioReadback() starts a
+// copy of the mode 1.5 output (bound as read buffer) into the next PBO of
+// the ring and returns at once. The samples land in left/right when the
+// slot is needed again AUDIO_PBO_RING frames later, as soon as a fence
+// shows the copy is done, or in FlushRecording().
+
+void Frame_Window::QueueAudioReadback(float *left, float *right, int n)
+{
+	// collect frames that have already arrived
+	for(int i=0; sync_fun && i<AUDIO_PBO_RING; ++i)
+	{
+		if(!audio_pbo_dest[i][0] || !audio_fence[i]) continue;
+
+		GLenum r = sync_fun->glClientWaitSync(audio_fence[i], 0, 0);
+		if(r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED)
+			CompleteAudioReadback(i);
+	}
+
+	int slot = audio_pbo_next;
+	audio_pbo_next = (slot+1) % AUDIO_PBO_RING;
+
+	if(audio_pbo_dest[slot][0]) CompleteAudioReadback(slot);
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,audio_pbo[slot]);
+	glBufferData(GL_PIXEL_PACK_BUFFER,2*n*sizeof(GLfloat),NULL,
+			GL_STREAM_READ);
+	glReadPixels(0, 0, 2, n,GL_RED, GL_FLOAT, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	if(sync_fun)
+		audio_fence[slot] = sync_fun->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE,
+				0);
+
+	audio_pbo_dest[slot][0] = left;
+	audio_pbo_dest[slot][1] = right;
+	audio_pbo_samples[slot] = n;
+}
+
+void Frame_Window::CompleteAudioReadback(int slot)
+{
+	if(audio_fence[slot])
+	{
+		sync_fun->glDeleteSync(audio_fence[slot]);
+		audio_fence[slot] = 0;
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,audio_pbo[slot]);
+	const GLfloat *p = static_cast<const GLfloat *>(
+			#ifndef __APPLE__
+			OGL_Fun.
+			#endif
+			glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY));
+
+	if(p == NULL)
+	{
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+		throw AeoException("Could not map the audio readback buffer");
+	}
+
+	// rows of left, right pairs
+	float *left = audio_pbo_dest[slot][0];
+	float *right = audio_pbo_dest[slot][1];
+	for(int i=0; i<audio_pbo_samples[slot]; ++i)
+	{
+		left[i] = p[2*i];
+		right[i] = p[2*i+1];
+	}
+
+	#ifndef __APPLE__
+	OGL_Fun.
+	#endif
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+
+	audio_pbo_dest[slot][0] = audio_pbo_dest[slot][1] = NULL;
+}
+
+void Frame_Window::FlushRecording()
+{
+	bool pending = false;
+	for(int i=0; i<AUDIO_PBO_RING; ++i)
+		if(audio_pbo_dest[i][0]) pending = true;
+
+	if(!pending) return;
+
+	if(!makeContextCurrent())
+	{
+		// the samples are lost; do not write them anywhere later
+		for(int i=0; i<AUDIO_PBO_RING; ++i)
+			audio_pbo_dest[i][0] = audio_pbo_dest[i][1] = NULL;
+		throw AeoException("No OpenGL context to finish the audio readback");
+	}
+
+	// oldest first
+	for(int k=0; k<AUDIO_PBO_RING; ++k)
+	{
+		int slot = (audio_pbo_next + k) % AUDIO_PBO_RING;
+		if(audio_pbo_dest[slot][0]) CompleteAudioReadback(slot);
+	}
+}
+
+int Frame_Window::RecordingCompleted(const float *start, int position) const
+{
+	for(int i=0; i<AUDIO_PBO_RING; ++i)
+	{
+		if(audio_pbo_dest[i][0])
+			position = std::min(position, int(audio_pbo_dest[i][0] - start));
+	}
+
+	return position;
+}
+
 float *Frame_Window::GetCalibrationMask()
 {
 	/*
@@ -1453,6 +2002,435 @@ float Frame_Window::GetAverage(GLfloat* dArray, int iSize)
 	return float (dSum/iSize);
 }
 
+//-----------------------------------------------------------------------------
+// Row means of adj_frame_tex and, for two sources, prev_frame_tex over
+// the left and right halves of the sound track and over the picture
+// bounds. Mode 7 averages each range in ROW_SEGMENTS segments of the
+// work textures, about one tap per input pixel, and mode 8 halves the
+// segments until out[src] has one column per range. Modes 1, 1.5 and 4
+// then take one or two lookups per output row instead of looping over
+// 1024-2048 taps of the frame.
+
+void Frame_Window::RowMeans(const GLubyte *indices, int rows,
+		const GLuint *work, const GLuint *out, int sources)
+{
+	float widest = std::max((bounds[1]-bounds[0])/2, pixbounds[1]-pixbounds[0]);
+	float taps = std::ceil(widest * input_w / ROW_SEGMENTS);
+	taps = std::min(std::max(taps, 1.0f), 256.0f); // the shader's limit
+
+	CUR_OP("Row means (modes 7 and 8)");
+
+	// nothing being drawn into is bound for sampling
+	for(int i=0; i<3; ++i)
+	{
+		glActiveTexture(GL_TEXTURE12+i);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER,row_fbo);
+
+	for(int src=0; src<sources; ++src)
+	{
+		int segments = ROW_SEGMENTS;
+		int pass = 0;
+
+		m_program->setUniformValue(m_rendermode_loc, 7.0f);
+		m_program->setUniformValue(m_rowcontrol_loc, float(src), taps,
+				0.0f, float(ROW_SEGMENTS));
+		glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,
+				GL_TEXTURE_2D,work[0],0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+		glViewport(0,0, 3*segments, rows);
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
+		CHECK_GL_ERROR(__FILE__,__LINE__);
+
+		m_program->setUniformValue(m_rendermode_loc, 8.0f);
+		while(segments > 1)
+		{
+			GLuint target = (segments == 2) ? out[src] : work[(pass+1)&1];
+
+			glActiveTexture(GL_TEXTURE14);
+			glBindTexture(GL_TEXTURE_2D, work[pass&1]);
+			glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,
+					GL_TEXTURE_2D,target,0);
+			m_program->setUniformValue(m_rowcontrol_loc, float(src), taps,
+					float(segments), float(ROW_SEGMENTS));
+			glViewport(0,0, 3*(segments/2), rows);
+			glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
+			CHECK_GL_ERROR(__FILE__,__LINE__);
+
+			segments /= 2;
+			++pass;
+		}
+	}
+
+	for(int i=0; i<2; ++i)
+	{
+		glActiveTexture(GL_TEXTURE12+i);
+		glBindTexture(GL_TEXTURE_2D, row_mean_texture[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
+
+//-----------------------------------------------------------------------------
+// Batched extraction. GLSL 1.20 has no texture arrays, so the frames of a
+// batch are stacked in one tall texture: mode 0 draws them all at once,
+// keeping each frame's kernels inside its own rows, and the row mean
+// passes run once over the whole stack. Only the row means come back;
+// the overlap search and audio are resolved frame by frame on the CPU.
+
+static void BatchTexture(GLuint tex, GLenum internalformat, int width,
+		int height, GLenum filter)
+{
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexImage2D(GL_TEXTURE_2D,0,internalformat,width,height,0,
+			GL_RGBA,GL_FLOAT,NULL);
+}
+
+int Frame_Window::BeginBatch(int frames)
+{
+	if(!makeContextCurrent())
+		throw AeoException("Batch: no GL context");
+
+	GLint maxSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	frames = std::min(frames, int(maxSize / input_h));
+	frames = std::min(frames,
+			int(BATCH_MAX_PIXELS / (size_t(input_w) * input_h)));
+	frames = std::max(frames, 1);
+
+	if(frames == batch_frames) return frames;
+
+	CUR_OP("Allocating batch textures");
+	EndBatch();
+	batch_frames = frames;
+	int h = frames * input_h;
+
+	// the frame stack gets its storage from the first frame loaded
+	glActiveTexture(GL_TEXTURE0);
+	glGenTextures(1,&batch_frame_texture);
+	glBindTexture(GL_TEXTURE_2D, batch_frame_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	batch_frame_format = 0;
+
+	glGenTextures(1,&batch_adj_texture);
+	BatchTexture(batch_adj_texture, GL_RGB16F, input_w, h, GL_LINEAR);
+	glGenTextures(2,batch_row_texture);
+	for(int i=0; i<2; ++i)
+		BatchTexture(batch_row_texture[i], GL_RGBA32F, 3*ROW_SEGMENTS, h,
+				GL_NEAREST);
+	glGenTextures(1,&batch_mean_texture);
+	BatchTexture(batch_mean_texture, GL_RGBA32F, 3, h, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, frame_texture);
+
+	glGenFramebuffers(1,&batch_fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER,batch_fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,
+			batch_adj_texture,0);
+	glBindFramebuffer(GL_FRAMEBUFFER,0);
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	return frames;
+}
+
+void Frame_Window::EndBatch()
+{
+	if(!batch_frames) return;
+
+	glDeleteFramebuffers(1,&batch_fbo);
+	glDeleteTextures(1,&batch_frame_texture);
+	glDeleteTextures(1,&batch_adj_texture);
+	glDeleteTextures(2,batch_row_texture);
+	glDeleteTextures(1,&batch_mean_texture);
+	batch_fbo = 0;
+	batch_frame_texture = batch_adj_texture = batch_mean_texture = 0;
+	batch_row_texture[0] = batch_row_texture[1] = 0;
+	batch_frame_format = 0;
+	batch_frames = 0;
+}
+
+void Frame_Window::LoadBatchFrame(FrameTexture *frame, int slot)
+{
+	if(slot < 0 || slot >= batch_frames)
+		throw AeoException("Batch: frame slot out of range");
+	if(frame->width != input_w || frame->height != input_h)
+		throw AeoException("Batch: frame size differs from the source");
+	if(!makeContextCurrent())
+		throw AeoException("Batch: no GL context");
+
+	GLenum internalformat = (frame->nComponents == 1) ? GL_R16 : GL_RGB16;
+	if(internalformat != batch_frame_format)
+	{
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, batch_frame_texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalformat, input_w,
+				batch_frames*input_h, 0,
+				internalformat==GL_R16 ? GL_RED : GL_RGB, GL_UNSIGNED_SHORT,
+				NULL);
+		batch_frame_format = internalformat;
+	}
+
+	UploadFrame(frame, batch_frame_texture, slot*input_h);
+}
+
+void Frame_Window::RenderBatch(int frames, float *rows)
+{
+	if(frames < 1 || frames > batch_frames)
+		throw AeoException("Batch: frame count out of range");
+	if(!makeContextCurrent())
+		throw AeoException("Batch: no GL context");
+
+	GLfloat verticesPix[] ={
+		-1, -1, 0, // bottom left corner
+		-1,  1, 0, // top left corner
+		 1,  1, 0, // top right corner
+		 1, -1, 0  // bottom right corner
+	};
+
+	GLubyte indices[] = {
+		0,1,2, // first triangle (bottom left - top left - top right)
+		0,2,3  // second triangle (bottom left - top right - bottom right)
+	};
+
+	GLfloat verticesTex[] ={
+		0, 0, 0, // bottom left corner
+		0, 1, 0, // top left corner
+		1, 1, 0, // top right corner
+		1, 0, 0  // bottom right corner
+	};
+
+	m_program->bind();
+	if(toneCurve.Update(negative, lift, gamma, gain, thresh, threshold))
+		UploadToneCurve();
+	update_parameters();
+	m_program->setUniformValue(m_luma_loc,
+			float(batch_frame_format == GL_R16));
+	m_program->setUniformValue(m_batch_loc, float(frames),
+			float(batch_frames));
+
+	glVertexAttribPointer(m_posAttr, 3, GL_FLOAT, GL_FALSE, 0, verticesPix);
+	glVertexAttribPointer(m_texAttr, 3, GL_FLOAT, GL_FALSE, 0, verticesTex);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	CUR_OP("Batch adjustment (mode 0)");
+	NextPassFrame();
+	BeginPass(PASS_ADJUST);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, batch_frame_texture);
+	m_program->setUniformValue(m_rendermode_loc, 0.0f);
+	glBindFramebuffer(GL_FRAMEBUFFER,batch_fbo);
+	glDrawBuffer(GL_COLOR_ATTACHMENT0);
+	glViewport(0,0, input_w, frames*input_h);
+	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, batch_adj_texture);
+	BeginPass(PASS_ROW_MEANS);
+	RowMeans(indices, frames*input_h, batch_row_texture, &batch_mean_texture,
+			1);
+	EndPass();
+
+	// RowMeans() leaves row_fbo drawing into batch_mean_texture
+	CUR_OP("Batch row mean readback");
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0,0, 3, frames*input_h, GL_RGBA, GL_FLOAT, rows);
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	glBindFramebuffer(GL_FRAMEBUFFER,0);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, adj_frame_texture);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, frame_texture);
+	m_program->setUniformValue(m_batch_loc, 1.0f, 1.0f);
+	m_program->setUniformValue(m_luma_loc, float(frame_tex_format == GL_R16));
+
+	glDisableVertexAttribArray(1);
+	glDisableVertexAttribArray(0);
+	m_program->release();
+}
+
+//-----------------------------------------------------------------------------
+// Pass timers. Each frame uses the next slot of the query ring, and a
+// query is only waited for when its slot comes round again, by which
+// time the GPU has long finished it; otherwise results are picked up as
+// they become available, so timing does not stall the pipeline.
+
+static const char *passNames[GPU_PASSES] = {
+	"adjustment (mode 0)",
+	"row means (modes 7, 8)",
+	"audio (mode 1)",
+	"calibration",
+	"overlap profiles (mode 4)",
+	"overlap compare",
+	"video output",
+	"screen (modes 2, 3)",
+	"file audio (mode 1.5)"
+};
+
+void Frame_Window::ResetPassTimes()
+{
+	for(int p=0; p<GPU_PASSES; ++p)
+	{
+		pass_time[p] = 0;
+		pass_count[p] = 0;
+	}
+}
+
+void Frame_Window::NextPassFrame()
+{
+	if(!time_passes) return;
+
+	EndPass();
+	CollectPassTimes(false);
+	pass_slot = (pass_slot+1) % GPU_TIMER_RING;
+}
+
+void Frame_Window::BeginPass(int pass)
+{
+	if(!time_passes) return;
+
+	EndPass();
+
+	QOpenGLTimerQuery *query = pass_query[pass_slot][pass];
+	if(pass_pending[pass_slot][pass])
+	{
+		pass_time[pass] += query->waitForResult();
+		++pass_count[pass];
+	}
+
+	query->begin();
+	pass_pending[pass_slot][pass] = false;
+	pass_active = pass;
+}
+
+void Frame_Window::EndPass()
+{
+	if(pass_active < 0) return;
+
+	pass_query[pass_slot][pass_active]->end();
+	pass_pending[pass_slot][pass_active] = true;
+	pass_active = -1;
+}
+
+void Frame_Window::CollectPassTimes(bool wait)
+{
+	for(int i=0; i<GPU_TIMER_RING; ++i)
+	{
+		for(int p=0; p<GPU_PASSES; ++p)
+		{
+			if(!pass_pending[i][p]) continue;
+			if(!wait && !pass_query[i][p]->isResultAvailable()) continue;
+
+			pass_time[p] += pass_query[i][p]->waitForResult();
+			++pass_count[p];
+			pass_pending[i][p] = false;
+		}
+	}
+}
+
+void Frame_Window::ReportPassTimes(QTextStream &out)
+{
+	if(!time_passes || !makeContextCurrent()) return;
+
+	EndPass();
+	CollectPassTimes(true);
+
+	out << "GPU time per pass:\n";
+	for(int p=0; p<GPU_PASSES; ++p)
+	{
+		if(pass_count[p] == 0) continue;
+
+		out << "  " << passNames[p] << ": " <<
+				pass_time[p] / pass_count[p] / 1.0e6 << " ms x " <<
+				pass_count[p] << " = " << pass_time[p] / 1.0e6 << " ms\n";
+	}
+}
+
+//-----------------------------------------------------------------------------
+// OverlapSearch::FindBestMatch() without reading the mode 5 errors back.
+// Mode 6 reduces REDUCE_STEP errors per texel, one row per search window,
+// carrying (error, index, subsample); each pass divides the width by
+// REDUCE_STEP until a single column with the minimum of every window is
+// left, which is all that is read back.
+
+void Frame_Window::GpuBestMatch(const GLubyte *indices, int &start, int &end)
+{
+	int n = samplesperframe;
+	int lo[OVERLAP_WINDOWS], hi[OVERLAP_WINDOWS];
+	GLfloat range[2*OVERLAP_WINDOWS];
+	GLfloat result[3*OVERLAP_WINDOWS];
+	OverlapMatch found[OVERLAP_WINDOWS];
+	int w;
+
+	OverlapSearch::SearchWindows(n, overlap, lo, hi);
+	start = lo[0];
+	end = hi[0];
+
+	// positions lo+1..hi are the error indices n-hi..n-lo-1
+	for(w=0; w<OVERLAP_WINDOWS; ++w)
+	{
+		int l = (w == 0) ? std::min(lo[w], hi[w]-1) : lo[w];
+		range[2*w] = n - hi[w];
+		range[2*w+1] = n - l - 1;
+	}
+
+	CUR_OP("Reducing overlap errors (mode 6)");
+	m_program->setUniformValue(m_rendermode_loc, 6.0f);
+	m_program->setUniformValueArray(m_reducewin_loc, range, OVERLAP_WINDOWS,
+			2);
+	glBindFramebuffer(GL_FRAMEBUFFER,reduce_fbo);
+
+	int width = n;
+	int pass = 0;
+
+	do
+	{
+		int outw = (width + REDUCE_STEP-1) / REDUCE_STEP;
+
+		// the input is never the texture being drawn into
+		glActiveTexture(GL_TEXTURE11);
+		glBindTexture(GL_TEXTURE_2D, reduce_texture[(pass+1)&1]);
+		glActiveTexture(GL_TEXTURE0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,
+				GL_TEXTURE_2D,reduce_texture[pass&1],0);
+		glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+		m_program->setUniformValue(m_reduce_loc, float(pass == 0),
+				float(width), float(n), float(reduce_width));
+		glViewport(0,0, outw, OVERLAP_WINDOWS);
+		glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_BYTE, indices);
+		CHECK_GL_ERROR(__FILE__,__LINE__);
+
+		width = outw;
+		++pass;
+	} while(width > 1);
+
+	CUR_OP("reading overlap window minima");
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glReadPixels(0,0,1,OVERLAP_WINDOWS,GL_RGB,GL_FLOAT,result);
+	CHECK_GL_ERROR(__FILE__,__LINE__);
+
+	for(w=0; w<OVERLAP_WINDOWS; ++w)
+	{
+		found[w].value = result[3*w];
+		found[w].postion = n - int(result[3*w+1]);
+		found[w].subsample = result[3*w+2];
+	}
+
+	OverlapSearch::ResolveMatch(found, lo, hi, is_calc, bestmatch,
+			match_array);
+}
+
 void Frame_Window::GetBestMatchFromFloatArray(GLfloat* dArray, int iSize,
 		int start , overlap_match &bmatch)
 {
@@ -33,14 +33,46 @@
 #include <QtCore/qmath.h>
 //#include <QtOpenGL>
 #include <QOpenGLFunctions_3_0>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLTexture>
+#include <QOpenGLTimerQuery>
 #include <QSurfaceFormat>
 #include <QContextMenuEvent>
 
 #include "videoencoder.h"
+#include "overlapsearch.h"
+#include "tonecurve.h"
+#include "extractionbackend.h"
 
 typedef void (*FrameWindowCallbackFunction)(void *);
 
+// frames of file audio that can be in flight between GPU and CPU
+#define AUDIO_PBO_RING 3
+// scan frames that can be uploading while the next one is decoded
+#define FRAME_PBO_RING 2
+// error entries per texel in each reduction pass (mode 6 in the shader)
+#define REDUCE_STEP 16
+// segments per range in the first row mean pass (mode 7 in the shader)
+#define ROW_SEGMENTS 64
+// texels in a stack of batched frames (BeginBatch)
+#define BATCH_MAX_PIXELS (32*1024*1024)
+// frames of pass timer queries in flight
+#define GPU_TIMER_RING 3
+
+// render passes timed on the GPU, in the order render() runs them
+enum GpuPass {
+	PASS_ADJUST,    // mode 0
+	PASS_ROW_MEANS, // modes 7 and 8
+	PASS_AUDIO,     // mode 1 display
+	PASS_CAL,
+	PASS_PROFILE,   // mode 4
+	PASS_OVERLAP,   // FFT search or modes 5 and 6
+	PASS_VIDEO,
+	PASS_SCREEN,    // modes 2 and 3
+	PASS_FILE_AUDIO, // mode 1.5
+	GPU_PASSES
+};
+
 class Frame_Window : public OpenGLWindow
 {
 
@@ -53,10 +85,7 @@ public:
 
 	void CheckGLError(const char *fn, int line);
 
-	typedef struct  {
-		int postion;
-		float value;
-	} overlap_match;
+	typedef OverlapMatch overlap_match;
 
 	typedef struct  {
 		GLuint video_output_fbo;
@@ -70,15 +99,43 @@ public:
 
 	//load frame from pointer
 	void load_frame_texture(FrameTexture *frame);
+	// A frame whose buf is a mapped unpack buffer the size of the frames
+	// loaded so far, for the decoder to write into; pass it to
+	// load_frame_texture(). NULL until the first frame has been loaded
+	// or if buffers cannot be mapped.
+	FrameTexture *MapFrameBuffer();
+
+	// Batched extraction: up to BeginBatch() frames of the source size
+	// are stacked in one texture, adjusted in a single mode 0 draw and
+	// reduced to row means together. RenderBatch() reads back 3 RGBA
+	// means (left and right half of the track, picture) per input row,
+	// frame after frame. Returns the number of frames that fit.
+	int BeginBatch(int frames);
+	void LoadBatchFrame(FrameTexture *frame, int slot);
+	void RenderBatch(int frames, float *rows);
+	void EndBatch();
+
+	// GPU time of each pass since ResetPassTimes(), from GL_TIME_ELAPSED
+	// queries collected a few frames after they were issued. Nothing is
+	// reported without GL_ARB_timer_query.
+	void ResetPassTimes();
+	void ReportPassTimes(QTextStream &out);
 
 	float GetAverage(GLfloat *, int ) ;
 	int GetMinLoc(GLfloat*, int ) ;
 	void GetBestMatchFromFloatArray(GLfloat*, int , int ,overlap_match &) ;
 	float GetMin(GLfloat* dArray, int iSize) ;
-	void PrepareRecording(int numsamples) ;
-	void ProcessRecording(int numsamples);
-	void DestroyRecording( );
-	float **GetRecording() const { return FileRealBuffer; }
+	// mode 1.5 writes each frame's samples to buf from pos on while
+	// is_rendering; the buffer belongs to the ExtractionBackend
+	void SetRecordingBuffer(float **buf, int pos);
+	int RecordingPosition() const { return samplepointer; }
+	// position up to which the samples written from start are in place;
+	// the readbacks still pending are behind it
+	int RecordingCompleted(const float *start, int position) const;
+	// copy out file audio still in flight; call before using the buffer
+	void FlushRecording();
+	ExtractionParameters Parameters() const;
+	void SetParameters(const ExtractionParameters &params);
     void PrepareVideoOutput(FrameTexture *frame)	;
 	float GetMax(GLfloat* dArray, int iSize) ;
 	void read_frame_texture(FrameTexture *frame);
@@ -112,6 +169,9 @@ public:
 	bool is_preload;
 	bool is_calc;
 	bool is_calculating;
+	bool fft_overlap; // search overlap on the CPU instead of mode 5
+	bool track_pitch; // with fft_overlap: this frame follows the last one
+	bool gpu_match; // find the mode 5 minimum on the GPU (mode 6)
 	int samplesperframe;
 	int samplesperframe_file;
 	overlap_match bestmatch;
@@ -138,9 +198,14 @@ public:
 	int height_inc;
 	bool overlapshow;
 	bool is_rendering;
+	bool async_readback; // file audio through the PBO ring, not glReadPixels
+	bool is_extracting; // only the passes the file audio needs
+	int preview_interval; // while extracting, frames per screen update
 	bool is_debug;
 	bool is_videooutput;
 	int overrideOverlap;
+	bool fixed_overlap; // use fixed_match instead of modes 4 and 5
+	overlap_match fixed_match;
 
 	float fps;
 	unsigned long duration; // milliseconds
@@ -166,9 +231,39 @@ private:
 	bool new_frame; //is a new frame from seq
 
 	void CopyFrameBuffer(GLuint fbo, int width, int height);
+	void UploadToneCurve();
+	void AllocateFrameTexture(int width, int height, GLenum internalformat);
+	void GpuBestMatch(const GLubyte *indices, int &start, int &end);
+	void UploadFrame(FrameTexture *frame, GLuint texture, int yoffset);
+	void NextPassFrame();
+	void BeginPass(int pass);
+	void EndPass();
+	void CollectPassTimes(bool wait);
+	void RowMeans(const GLubyte *indices, int rows, const GLuint *work,
+			const GLuint *out, int sources);
+	void QueueAudioReadback(float *left, float *right, int n);
+	void CompleteAudioReadback(int slot);
 
 	GLenum *audio_draw_buffers;
-	GLuint audio_pbo;
+
+	// mode 1.5 readback ring: destination and size of each frame in flight
+	GLuint audio_pbo[AUDIO_PBO_RING];
+	GLsync audio_fence[AUDIO_PBO_RING];
+	float *audio_pbo_dest[AUDIO_PBO_RING][2];
+	int audio_pbo_samples[AUDIO_PBO_RING];
+	int audio_pbo_next;
+	GLuint video_pbo; // video output, read back during the audio passes
+	bool video_pbo_pending;
+	QOpenGLExtraFunctions *sync_fun; // fences; NULL without ARB_sync
+
+	// pass timers: one query per pass for each frame in flight
+	bool time_passes;
+	QOpenGLTimerQuery *pass_query[GPU_TIMER_RING][GPU_PASSES];
+	bool pass_pending[GPU_TIMER_RING][GPU_PASSES];
+	int pass_slot;
+	int pass_active; // -1 if no query is running
+	double pass_time[GPU_PASSES]; // nanoseconds
+	long pass_count[GPU_PASSES];
 	GLuint m_posAttr; //vertex buffer
 	GLuint m_texAttr;
 	GLuint m_matrixUniform; //sizing matrix currently unused
@@ -187,7 +282,38 @@ private:
     GLuint m_rot_angle; // bind for rotation angle
 	GLuint m_calcontrol_loc;
 	GLuint m_overlapshow_loc;
+	GLuint m_luma_loc;
+	GLuint m_reduce_loc;
+	GLuint m_reducewin_loc;
+	GLuint reduce_fbo; // mode 6 passes ping-pong between reduce_texture
+	GLuint reduce_texture[2];
+	int reduce_width;
+	GLuint m_rowcontrol_loc;
+	GLuint row_fbo; // modes 7 and 8 ping-pong between row_texture
+	GLuint row_texture[2];
+	GLuint row_mean_texture[2]; // of adj_frame_tex and prev_frame_tex
+	GLuint m_batch_loc;
+	int batch_frames; // frames the batch textures hold, 0 if none
+	GLuint batch_fbo;
+	GLuint batch_frame_texture; // frames stacked bottom up
+	GLenum batch_frame_format;
+	GLuint batch_adj_texture;
+	GLuint batch_row_texture[2];
+	GLuint batch_mean_texture;
 	GLuint frame_texture; //image frame texture used as input
+	int frame_tex_w; // size of the storage of frame_texture
+	int frame_tex_h;
+	GLenum frame_tex_format; // GL_RGB16, or GL_R16 for lightness frames
+	bool has_tex_storage; // immutable storage (ARB_texture_storage)
+
+	// scan upload ring: frame_upload_map is the mapped buffer of
+	// frame_pbo[frame_pbo_next] while the decoder fills it, through
+	// frame_upload unless the frame did not fit
+	GLuint frame_pbo[FRAME_PBO_RING];
+	int frame_pbo_next;
+	size_t frame_pbo_size;
+	uint8_t *frame_upload_map;
+	FrameTexture frame_upload;
 	GLuint adj_frame_fbo; //render fbo writes to adj frame texture
 
 	GLuint adj_frame_texture; //render with pixel/image adjustments
@@ -208,8 +334,15 @@ private:
 
 	GLuint cal_audio_texture;
 
+	ToneCurve toneCurve;
+	GLuint tone_lut_texture; // 1d RGB: curve, levels, S-curve
+	GLint tone_lut_size;
+	GLuint m_tonelut_loc;
+
 	QOpenGLShaderProgram *m_program; //gpu opengl executable
 
+	OverlapSearch overlapSearch;
+
 	int m_frame;
 
 	QOpenGLFunctions_3_0  OGL_Fun;
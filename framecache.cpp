@@ -0,0 +1,165 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "framecache.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QSettings>
+
+FrameCache::FrameCache(size_t l)
+{
+	bytes = 0;
+	limit = l;
+}
+
+FrameCache::~FrameCache()
+{
+	Clear();
+}
+
+FrameCache &FrameCache::Shared()
+{
+	static FrameCache *shared = NULL;
+	static QMutex create;
+
+	QMutexLocker locker(&create);
+	if(!shared)
+	{
+		QSettings settings;
+		int mb = settings.value("cache/frame-megabytes", 1024).toInt();
+		shared = new FrameCache(size_t(std::max(mb, 0)) << 20);
+	}
+
+	return *shared;
+}
+
+size_t FrameCache::Bytes(const FrameTexture *frame)
+{
+	size_t pixels = size_t(frame->width) * frame->height;
+
+	switch(frame->format)
+	{
+	case GL_UNSIGNED_INT_10_10_10_2: return pixels * 4;
+	case GL_UNSIGNED_BYTE: return pixels * frame->nComponents;
+	default: return pixels * frame->nComponents * 2;
+	}
+}
+
+bool FrameCache::Get(const std::string &source, long frame,
+		FrameTexture *out)
+{
+	QMutexLocker locker(&lock);
+
+	std::map<Key, Order::iterator>::iterator found =
+			index.find(Key(source, frame));
+	if(found == index.end()) return false;
+
+	// now the most recently used
+	order.splice(order.begin(), order, found->second);
+
+	const Entry &e = order.front();
+	// a buffer without room is replaced; a borrowed one is left to its owner
+	if(out->buf == NULL ||
+			(out->bufSize > 0 && size_t(out->bufSize) < e.bytes))
+	{
+		if(out->buf && !out->borrowed) delete [] out->buf;
+		out->borrowed = false;
+		out->bufSize = int(e.bytes);
+		out->buf = new uint8_t [e.bytes];
+	}
+
+	std::memcpy(out->buf, e.frame->buf, e.bytes);
+	out->width = e.frame->width;
+	out->height = e.frame->height;
+	out->format = e.frame->format;
+	out->nComponents = e.frame->nComponents;
+	out->isNonNativeEndianess = e.frame->isNonNativeEndianess;
+
+	return true;
+}
+
+bool FrameCache::Contains(const std::string &source, long frame)
+{
+	QMutexLocker locker(&lock);
+	return index.find(Key(source, frame)) != index.end();
+}
+
+void FrameCache::Put(const std::string &source, long frame,
+		FrameTexture *decoded)
+{
+	QMutexLocker locker(&lock);
+
+	Key key(source, frame);
+	std::map<Key, Order::iterator>::iterator found = index.find(key);
+	if(found != index.end())
+	{
+		bytes -= found->second->bytes;
+		delete found->second->frame;
+		order.erase(found->second);
+		index.erase(found);
+	}
+
+	Entry e;
+	e.key = key;
+	e.frame = decoded;
+	e.bytes = Bytes(decoded);
+
+	order.push_front(e);
+	index[key] = order.begin();
+	bytes += e.bytes;
+
+	Trim();
+}
+
+void FrameCache::SetLimit(size_t l)
+{
+	QMutexLocker locker(&lock);
+
+	limit = l;
+	Trim();
+}
+
+void FrameCache::Clear()
+{
+	QMutexLocker locker(&lock);
+
+	for(Order::iterator i = order.begin(); i != order.end(); ++i)
+		delete i->frame;
+	order.clear();
+	index.clear();
+	bytes = 0;
+}
+
+void FrameCache::Trim()
+{
+	while(bytes > limit && !order.empty())
+	{
+		Entry &e = order.back();
+		bytes -= e.bytes;
+		delete e.frame;
+		index.erase(e.key);
+		order.pop_back();
+	}
+}
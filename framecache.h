@@ -0,0 +1,82 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <QMutex>
+
+#include "videoencoder.h"
+
+// Decoded frames kept for revisiting: a least recently used cache bounded
+// by the bytes of image data it holds, keyed by source and frame number.
+// Shared by every FilmScan that has been given it, on any thread.
+class FrameCache
+{
+public:
+	FrameCache(size_t limit);
+	~FrameCache();
+
+	// the cache of the application, sized by the "cache/frame-megabytes"
+	// setting
+	static FrameCache &Shared();
+
+	// copy the frame into out, allocating out->buf if it is NULL as the
+	// decoders do; false if it is not cached
+	bool Get(const std::string &source, long frame, FrameTexture *out);
+	bool Contains(const std::string &source, long frame);
+	// takes ownership of the frame, which may be dropped at once
+	void Put(const std::string &source, long frame, FrameTexture *decoded);
+
+	void SetLimit(size_t bytes);
+	size_t Limit() const { return limit; }
+	void Clear();
+
+	// bytes of image data in a decoded frame
+	static size_t Bytes(const FrameTexture *frame);
+
+private:
+	typedef std::pair<std::string, long> Key;
+	typedef struct {
+		Key key;
+		FrameTexture *frame;
+		size_t bytes;
+	} Entry;
+	typedef std::list<Entry> Order; // most recently used first
+
+	void Trim(); // drop the least recently used down to the limit
+
+	QMutex lock;
+	Order order;
+	std::map<Key, Order::iterator> index;
+	size_t bytes;
+	size_t limit;
+};
+
+#endif // FRAMECACHE_H
@@ -0,0 +1,185 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "frameloader.h"
+
+#include <exception>
+#include <utility>
+
+FrameLoader::FrameLoader(const FilmScan &source, QObject *parent)
+	: QThread(parent)
+{
+	sourceName = source.GetFileName();
+	sourceFormat = source.GetFormat();
+	lumaOnly = source.IsLumaOnly();
+	cache = source.GetFrameCache();
+	strip = source.GetStripCache();
+
+	quit = false;
+	requested = -1;
+	requestedPrevious = false;
+	pending = false;
+
+	for(int i=0; i<2; ++i)
+	{
+		work[i] = new FrameTexture;
+		ready[i] = new FrameTexture;
+		shown[i] = new FrameTexture;
+	}
+	haveReady = false;
+	readyPrevious = false;
+	readyFrame = -1;
+	readyGeneration = 0;
+
+	start();
+}
+
+FrameLoader::~FrameLoader()
+{
+	lock.lock();
+	quit = true;
+	latest.fetchAndAddOrdered(1); // abandon the decode in progress
+	wake.wakeAll();
+	lock.unlock();
+	wait();
+
+	for(int i=0; i<2; ++i)
+	{
+		delete work[i];
+		delete ready[i];
+		delete shown[i];
+	}
+}
+
+void FrameLoader::Request(long frame, bool withPrevious)
+{
+	QMutexLocker locker(&lock);
+
+	// the same frame again, still waiting or being decoded
+	if(pending && frame == requested && withPrevious == requestedPrevious)
+		return;
+
+	requested = frame;
+	requestedPrevious = withPrevious;
+	pending = true;
+	latest.fetchAndAddOrdered(1);
+	wake.wakeAll();
+}
+
+bool FrameLoader::Take(long &frame, FrameTexture *&prev, FrameTexture *&cur)
+{
+	QMutexLocker locker(&lock);
+
+	if(!haveReady) return false;
+	haveReady = false;
+	if(Stale(readyGeneration)) return false;
+
+	std::swap(ready[0], shown[0]);
+	std::swap(ready[1], shown[1]);
+
+	frame = readyFrame;
+	prev = readyPrevious ? shown[0] : NULL;
+	cur = shown[1];
+	return true;
+}
+
+void FrameLoader::run()
+{
+	FilmScan scan;
+
+	try
+	{
+		if(!scan.Source(sourceName, sourceFormat))
+		{
+			emit Failed(QString("Frame loader: cannot open %1").arg(
+					QString::fromStdString(sourceName)));
+			return;
+		}
+		scan.SetLumaOnly(lumaOnly);
+		scan.SetFrameCache(cache);
+		scan.SetStripCache(strip);
+	}
+	catch(std::exception &e)
+	{
+		emit Failed(QString("Frame loader: %1").arg(e.what()));
+		return;
+	}
+
+	int done = 0; // generation last decoded
+
+	for(;;)
+	{
+		long frame;
+		bool withPrevious;
+		int generation;
+
+		lock.lock();
+		while(!quit && done == latest.loadAcquire())
+			wake.wait(&lock);
+		if(quit)
+		{
+			lock.unlock();
+			return;
+		}
+		frame = requested;
+		withPrevious = requestedPrevious;
+		generation = latest.loadAcquire();
+		lock.unlock();
+
+		done = generation;
+
+		try
+		{
+			if(withPrevious)
+			{
+				work[0] = scan.GetFrameImage(scan.FirstFrame()+frame-1,
+						work[0]);
+				if(Stale(generation)) continue;
+			}
+
+			work[1] = scan.GetFrameImage(scan.FirstFrame()+frame, work[1]);
+			if(Stale(generation)) continue;
+		}
+		catch(std::exception &e)
+		{
+			emit Failed(QString("Frame loader: frame %1: %2").
+					arg(frame).arg(e.what()));
+			lock.lock();
+			if(!Stale(generation)) pending = false;
+			lock.unlock();
+			continue;
+		}
+
+		lock.lock();
+		if(!Stale(generation)) pending = false;
+		std::swap(work[0], ready[0]);
+		std::swap(work[1], ready[1]);
+		haveReady = true;
+		readyPrevious = withPrevious;
+		readyFrame = frame;
+		readyGeneration = generation;
+		lock.unlock();
+
+		emit Loaded();
+	}
+}
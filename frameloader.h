@@ -0,0 +1,96 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef FRAMELOADER_H
+#define FRAMELOADER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+
+#include "FilmScan.h"
+
+// Decodes the frames asked for while scrubbing, on a thread of its own
+// with its own copy of the source. Only the latest request matters: each
+// one bumps a generation counter, requests made while a decode runs
+// replace each other, and a decode that has gone stale is abandoned at
+// the next frame boundary and never delivered. Dragging across a reel
+// therefore decodes as fast as the source allows and never queues up.
+class FrameLoader : public QThread
+{
+	Q_OBJECT
+
+public:
+	FrameLoader(const FilmScan &source, QObject *parent = 0);
+	~FrameLoader();
+
+	// frame counts from the source's first frame; the frame before it is
+	// decoded too when the overlap with it is wanted
+	void Request(long frame, bool withPrevious);
+
+	// The frames of the newest completed request, if it is still the
+	// latest one; prev is NULL if it was not asked for. They stay valid
+	// until the next Take().
+	bool Take(long &frame, FrameTexture *&prev, FrameTexture *&cur);
+
+signals:
+	// a request has been decoded; call Take() (queued to the GUI thread,
+	// so several may collapse into one Take())
+	void Loaded();
+	// a frame, or the source, could not be decoded
+	void Failed(QString message);
+
+protected:
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	bool Stale(int generation) const
+		{ return generation != latest.loadAcquire(); }
+
+	std::string sourceName;
+	SourceFormat sourceFormat;
+	bool lumaOnly;
+	FrameCache *cache;
+	StripCache *strip;
+
+	QMutex lock;
+	QWaitCondition wake;
+	bool quit;
+	long requested;
+	bool requestedPrevious;
+	bool pending; // the latest request is not decoded yet
+	QAtomicInt latest; // generation of the newest request
+
+	// the worker decodes into work, hands it over as ready and the GUI
+	// thread takes it as shown; only pointers move between them
+	FrameTexture *work[2];
+	FrameTexture *ready[2];
+	FrameTexture *shown[2];
+	bool haveReady;
+	bool readyPrevious;
+	long readyFrame;
+	int readyGeneration;
+};
+
+#endif // FRAMELOADER_H
@@ -0,0 +1,113 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "frameprefetcher.h"
+
+#include <algorithm>
+#include <exception>
+
+FramePrefetcher::FramePrefetcher(const FilmScan &source, int d,
+		QObject *parent)
+	: QThread(parent)
+{
+	sourceName = source.GetFileName();
+	sourceFormat = source.GetFormat();
+	lumaOnly = source.IsLumaOnly();
+	cache = source.GetFrameCache();
+	strip = source.GetStripCache();
+	numFrames = source.NumFrames();
+	depth = d;
+
+	quit = false;
+	next = 0;
+	end = 0;
+
+	start();
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+	lock.lock();
+	quit = true;
+	wake.wakeAll();
+	lock.unlock();
+	wait();
+}
+
+void FramePrefetcher::Advance(long frame)
+{
+	QMutexLocker locker(&lock);
+
+	next = std::max(next, frame);
+	end = std::min(frame + depth, numFrames);
+	wake.wakeAll();
+}
+
+void FramePrefetcher::run()
+{
+	FilmScan scan;
+
+	try
+	{
+		if(!scan.Source(sourceName, sourceFormat))
+		{
+			emit Failed(QString("Frame prefetcher: cannot open %1").arg(
+					QString::fromStdString(sourceName)));
+			return;
+		}
+		scan.SetLumaOnly(lumaOnly);
+		scan.SetFrameCache(cache);
+		scan.SetStripCache(strip);
+	}
+	catch(std::exception &e)
+	{
+		emit Failed(QString("Frame prefetcher: %1").arg(e.what()));
+		return;
+	}
+
+	for(;;)
+	{
+		long frame;
+
+		lock.lock();
+		while(!quit && next >= end)
+			wake.wait(&lock);
+		if(quit)
+		{
+			lock.unlock();
+			return;
+		}
+		frame = next++;
+		lock.unlock();
+
+		try
+		{
+			scan.CacheFrame(scan.FirstFrame()+frame);
+		}
+		catch(std::exception &e)
+		{
+			emit Failed(QString("Frame prefetcher: frame %1: %2").
+					arg(frame).arg(e.what()));
+		}
+	}
+}
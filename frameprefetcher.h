@@ -0,0 +1,74 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef FRAMEPREFETCHER_H
+#define FRAMEPREFETCHER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "FilmScan.h"
+
+// Decodes the frames just ahead of playback into the frame cache, on a
+// thread of its own with its own copy of the source, so the playback
+// only copies them out. It works through the frames from the one last
+// passed to Advance() up to depth frames further and then waits; frames
+// already played are skipped, not decoded late.
+class FramePrefetcher : public QThread
+{
+	Q_OBJECT
+
+public:
+	// the source must have a frame cache
+	FramePrefetcher(const FilmScan &source, int depth, QObject *parent = 0);
+	~FramePrefetcher();
+
+	// frame counts from the source's first frame
+	void Advance(long frame);
+
+signals:
+	// a frame, or the source, could not be decoded; the frame is then
+	// decoded again, and fails again, where it is played
+	void Failed(QString message);
+
+protected:
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	std::string sourceName;
+	SourceFormat sourceFormat;
+	bool lumaOnly;
+	FrameCache *cache;
+	StripCache *strip;
+	long numFrames;
+	int depth;
+
+	QMutex lock;
+	QWaitCondition wake;
+	bool quit;
+	long next; // frame to decode next
+	long end; // frames from here on are not wanted yet
+};
+
+#endif // FRAMEPREFETCHER_H
@@ -0,0 +1,91 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+
+#include "lightness.h"
+
+#include <algorithm>
+
+#include "aeoexception.h"
+
+void PixelLightness(const void *in, size_t n, GLenum format, int components,
+		bool swap, uint16_t *out)
+{
+	int nc = components;
+	int rgb = std::min(nc, 3);
+	size_t i;
+	int c;
+
+	switch(format)
+	{
+	case GL_UNSIGNED_INT_10_10_10_2:
+	{
+		const uint32_t *p = reinterpret_cast<const uint32_t *>(in);
+		for(i=0; i<n; ++i)
+		{
+			uint32_t v = p[i];
+			if(swap)
+				v = (v>>24) | ((v>>8)&0xFF00) | ((v<<8)&0xFF0000) | (v<<24);
+			uint32_t r = (v>>22)&0x3FF, g = (v>>12)&0x3FF, b = (v>>2)&0x3FF;
+			uint32_t mx = std::max(r, std::max(g, b));
+			uint32_t mn = std::min(r, std::min(g, b));
+			out[i] = uint16_t(((mx + mn) * 65535 + 1023) / 2046);
+		}
+		break;
+	}
+	case GL_UNSIGNED_SHORT:
+	{
+		const uint16_t *p = reinterpret_cast<const uint16_t *>(in);
+		for(i=0; i<n; ++i, p+=nc)
+		{
+			uint16_t mx = 0, mn = 0xFFFF;
+			for(c=0; c<rgb; ++c)
+			{
+				uint16_t v = p[c];
+				if(swap) v = uint16_t((v>>8) | (v<<8));
+				mx = std::max(mx, v);
+				mn = std::min(mn, v);
+			}
+			out[i] = uint16_t((uint32_t(mx) + mn + 1) >> 1);
+		}
+		break;
+	}
+	case GL_UNSIGNED_BYTE:
+	{
+		const uint8_t *p = reinterpret_cast<const uint8_t *>(in);
+		for(i=0; i<n; ++i, p+=nc)
+		{
+			uint8_t mx = 0, mn = 0xFF;
+			for(c=0; c<rgb; ++c)
+			{
+				mx = std::max(mx, p[c]);
+				mn = std::min(mn, p[c]);
+			}
+			out[i] = uint16_t(((uint32_t(mx) + mn) * 257 + 1) >> 1);
+		}
+		break;
+	}
+	default:
+		throw AeoException("Unsupported pixel format for lightness");
+	}
+}
@@ -0,0 +1,41 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+
+#ifndef LIGHTNESS_H
+#define LIGHTNESS_H
+
+#include <cstddef>
+#include <stdint.h>
+
+#include <QOpenGLTexture>
+
+// Reduce n decoded pixels to one 16-bit plane of HSL lightness,
+// (max+min)/2, rounded the same way as the CPU engine's fixed point
+// unpack. format and components are those of the FrameTexture the pixels
+// would go to; swap if they are not in native byte order. Used on whole
+// frames and by the readers on each scanline as it comes in.
+void PixelLightness(const void *in, size_t n, GLenum format, int components,
+		bool swap, uint16_t *out);
+
+#endif // LIGHTNESS_H
@@ -22,6 +22,7 @@
 //-----------------------------------------------------------------------------
 
 #include <algorithm>
+#include <cmath>
 
 #include <QApplication>
 #include <QByteArray>
@@ -50,6 +51,16 @@
 #include <QScrollArea>
 #include <QProgressDialog>
 #include <QStandardPaths>
+#include <QEventLoop>
+#include <QAudioFormat>
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+#include <QAudioSink>
+#include <QAudioDevice>
+#include <QMediaDevices>
+#else
+#include <QAudioOutput>
+#include <QAudioDeviceInfo>
+#endif
 
 #include <cstdio>
 #include <exception>
@@ -71,6 +82,14 @@
 #include "savesampledialog.h"
 #include "preferencesdialog.h"
 #include "extractdialog.h"
+#include "extractionworker.h"
+#include "frameloader.h"
+#include "framecache.h"
+#include "samplestream.h"
+#include "frameprefetcher.h"
+#include "stagecache.h"
+#include "stripcache.h"
+#include "overlapmap.h"
 
 #ifdef USE_MUX_HACK
 #include <stdlib.h>
@@ -262,10 +281,20 @@ MainWindow::MainWindow(QWidget *parent) :
 	currentMeta = NULL;
 	currentFrameTexture = NULL;
 	outputFrameTexture = NULL;
+	frameLoader = NULL;
+	previewStream = NULL;
+	previewOutput = NULL;
+	previewTimer = NULL;
+	prefetcher = NULL;
+	previewPlaying = false;
+	stripCache = new StripCache;
+	overlapMap = new OverlapMap;
+	overlapMapKey = 0;
 
 	// turn off stuff that can't be used until a project is loaded
 	ui->saveprojectButton->setEnabled(false);
 	ui->actionSave_Settings->setEnabled(false);
+	ui->actionBuild_Strip_Cache->setEnabled(false);
 	ui->actionShow_Overlap->setEnabled(false);
 	ui->actionShow_Soundtrack_Only->setEnabled(false);
 	ui->actionWaveform_Zoom->setEnabled(false);
@@ -345,6 +374,10 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+	StopPreview(false);
+	delete frameLoader;
+	delete stripCache;
+	delete overlapMap;
 	DeleteTempSoundFile();
 	delete ui;
 }
@@ -781,8 +814,21 @@ void MainWindow::GPU_Params_Update(bool renderyes)
 		else
 			frame_window->WFMzoom=1.0f;
 
+		int x0, x1;
+		ColumnsRead(frame_window->Parameters(), x0, x1);
+		UpdateStripCache(x0, x1);
+
+		// a streaming preview plays the new settings from the next frame
+		if(previewStream)
+		{
+			extraction->SetParameters(frame_window->Parameters());
+			previewKept[0].clear();
+			previewKept[1].clear();
+		}
+
+		// one render per display refresh however many controls change
 		if (renderyes)
-			frame_window->renderNow();
+			frame_window->renderLater();
 	}
 
 	// release the lock
@@ -794,49 +840,51 @@ bool MainWindow::Load_Frame_Texture(int frame_num)
 {
 	if (frame_window==NULL) return false;
 
-	if(!frame_window->isExposed())
+	if(extraction) extraction->SetFrameNumber(frame_num);
+	if(extraction && extraction->LoadCachedFrame(frame_num))
 	{
-		Log() << "Frame window not exposed. Attempting to raise.\n";
+		lastFrameLoad = frame_num;
+		return true;
+	}
 
-		frame_window->raise();
-		frame_window->showNormal();
-		frame_window->setWindowState(Qt::WindowActive);
-		//qApp->setActiveWindow(frame_window);
+	traceCurrentOperation = "Retrieving scan image";
+	FrameTexture *frame = NULL;
 
-		qApp->processEvents();
+	// when the window processes the frame, decode straight into GL memory
+	if(!extraction || extraction->UsesWindow())
+		frame = frame_window->MapFrameBuffer();
 
-		while (!frame_window->isExposed())
+	if(frame)
+		frame = this->scan.inFile.GetFrameImage(
+				this->scan.inFile.FirstFrame()+frame_num, frame);
+	else
+		frame = currentFrameTexture = this->scan.inFile.GetFrameImage(
+				this->scan.inFile.FirstFrame()+frame_num, currentFrameTexture);
+	if(extraction)
+	{
+		traceCurrentOperation = "Extracting frame";
+		if(!extraction->LoadFrame(frame))
 		{
-			Log() << "Frame window still not exposed. Asking for user help.\n";
-			int raise = QMessageBox::question(this, "Select image Window",
-					"The image window is obscured. Please move it to the front.",
-					QMessageBox::Ok | QMessageBox::Cancel,
-					QMessageBox::Ok);
-
-			if(raise == QMessageBox::Cancel)
-			{
-				Log() << "User cancelled (could not raise window?)\n";
-				LogClose();
-				return false;
-			}
+			Log() << "Frame " << frame_num << " was not processed\n";
+			return false;
 		}
+		traceCurrentOperation = "";
 	}
+	else
+	{
+		traceCurrentOperation = "Loading scan into texture";
+		frame_window->load_frame_texture(frame);
 
-	traceCurrentOperation = "Retrieving scan image";
-	currentFrameTexture = this->scan.inFile.GetFrameImage(
-			this->scan.inFile.FirstFrame()+frame_num, currentFrameTexture);
-	traceCurrentOperation = "Loading scan into texture";
-	frame_window->load_frame_texture(currentFrameTexture);
-
-	/*
-	traceCurrentOperation = "Freeing texture buffer";
-	if (frameTex)
-		delete frameTex;
-	*/
+		/*
+		traceCurrentOperation = "Freeing texture buffer";
+		if (frameTex)
+			delete frameTex;
+		*/
 
-	traceCurrentOperation = "GL render";
-	frame_window->renderNow();
-	traceCurrentOperation = "";
+		traceCurrentOperation = "GL render";
+		frame_window->renderNow();
+		traceCurrentOperation = "";
+	}
 
 	// record frame in static variable for debugging/restarting from error:
 	lastFrameLoad = frame_num;
@@ -844,6 +892,55 @@ bool MainWindow::Load_Frame_Texture(int frame_num)
 	return true;
 }
 
+// Show a frame picked with the slider or spin box. The decode runs on the
+// frame loader, which drops requests overtaken by newer ones; without it
+// the frames are loaded here and now.
+void MainWindow::ScrubToFrame(int frame_num)
+{
+	// load the previous frame so that overlap can be computed
+	bool withPrevious = frame_num > ui->frame_numberSpinBox->minimum();
+
+	if(frameLoader)
+	{
+		frameLoader->Request(frame_num, withPrevious);
+		return;
+	}
+
+	if(withPrevious)
+		Load_Frame_Texture(frame_num-1);
+	Load_Frame_Texture(frame_num);
+}
+
+void MainWindow::ShowLoadedFrame()
+{
+	long frame_num;
+	FrameTexture *prev;
+	FrameTexture *cur;
+
+	// an extraction on this thread owns the window until it is done
+	if(!frame_window || extraction) return;
+	if(!frameLoader->Take(frame_num, prev, cur)) return;
+
+	// the previous frame has to be rendered for the overlap with the
+	// current one; the current one is drawn on the next refresh
+	if(prev)
+	{
+		frame_window->load_frame_texture(prev);
+		frame_window->renderNow();
+	}
+	frame_window->load_frame_texture(cur);
+	frame_window->renderLater();
+
+	lastFrameLoad = frame_num;
+}
+
+// a decode on the loader or prefetcher thread failed
+void MainWindow::FrameDecodeFailed(QString message)
+{
+	Log() << message << "\n";
+	statusBar()->showMessage(message, 5000);
+}
+
 int MainWindow::MaxFrequency() const
 {
 	if(!this->frame_window) return -1;
@@ -945,8 +1042,26 @@ bool MainWindow::NewSource(QString filename, SourceFormat ft)
 
 	try
 	{
+		StopPreview(false);
+
+		// nothing of the old source may be delivered to the new window
+		delete frameLoader;
+		frameLoader = NULL;
+
 		traceCurrentOperation = "Opening Source";
 		this->scan.SourceScan(filename.toStdString(), ft);
+		{
+			QSettings settings;
+			this->scan.inFile.SetLumaOnly(
+					settings.value("extraction/luma-only", false).toBool());
+		}
+		FrameCache::Shared().Clear();
+		StageCache::Shared().Clear();
+		this->scan.inFile.SetFrameCache(&FrameCache::Shared());
+		// attached by UpdateStripCache() once the bounds are known
+		stripCache->Open(StripCache::FileFor(
+				this->scan.inFile.GetFileName()), this->scan.inFile);
+		this->scan.inFile.SetStripCache(NULL);
 		traceCurrentOperation = "Verifying scan is ready";
 		if(this->scan.inFile.IsReady())
 		{
@@ -970,6 +1085,8 @@ bool MainWindow::NewSource(QString filename, SourceFormat ft)
 			Log() << "New frame window\n";
 			frame_window->logger = &Log();
 
+			NewFrameLoader();
+
 			traceCurrentOperation = "Resizing window to 640x640";
 			frame_window->resize(640, 640);
 
@@ -1007,6 +1124,7 @@ bool MainWindow::NewSource(QString filename, SourceFormat ft)
 
 			// enable the rest of the UI that was waiting until a project loaded
 			ui->actionSave_Settings->setEnabled(true);
+			ui->actionBuild_Strip_Cache->setEnabled(true);
 			ui->actionShow_Overlap->setEnabled(true);
 			ui->actionShow_Soundtrack_Only->setEnabled(true);
 			ui->actionWaveform_Zoom->setEnabled(true);
@@ -1459,13 +1577,7 @@ void MainWindow::on_rightSlider_sliderMoved(int position)
 }
 void MainWindow::on_playSlider_sliderMoved(int position)
 {
-	FrameTexture *ft;
-
-	if(position > ui->frame_numberSpinBox->minimum())
-	{
-		Load_Frame_Texture(position-1);
-	}
-	Load_Frame_Texture(position);
+	ScrubToFrame(position);
 	ui->frame_numberSpinBox->setValue(position);
 	ui->frameNumberTimeCodeLabel->setText( Compute_Timecode_String(position));
 
@@ -1497,13 +1609,7 @@ void MainWindow::on_overlapSlider_valueChanged(int value)
 
 void MainWindow::on_frame_numberSpinBox_valueChanged(int arg1)
 {
-	// load the previous frame so that overlap can be computed
-
-	if(arg1 > ui->frame_numberSpinBox->minimum())
-		Load_Frame_Texture(arg1-1);
-
-
-	Load_Frame_Texture(arg1);
+	ScrubToFrame(arg1);
     ui->playSlider->setValue(  arg1);
      ui->frameNumberTimeCodeLabel->setText( Compute_Timecode_String(arg1));
 
@@ -1747,83 +1853,707 @@ void MainWindow::PlaySample(int index)
 //----------------------------------------------------------------------------
 void MainWindow::on_playSampleButton_clicked()
 {
-	ExtractedSound sample;
+	if(previewStream)
+		StopPreview(true);
+	else
+		StartPreview(false);
+}
 
-	// create a new sample:
-	QTemporaryFile qtmp(QDir::tempPath()+"/aeoXXXXXX.wav");
-	// open and close it to ensure the name is fully resolved
-	qtmp.setAutoRemove(false);
-	qtmp.open();
-	qtmp.close();
+void MainWindow::on_playButton_clicked()
+{
+	if(previewStream)
+		StopPreview(false);
+	else
+		StartPreview(true);
+}
 
-	long firstFrame = ui->frameInSpinBox->value() -
-			this->scan.inFile.FirstFrame();
-	long numFrames = 24 * 5;
-	if(numFrames >
-			this->scan.inFile.LastFrame() -
-			ui->frameInSpinBox->value())
+//----------------------------------------------------------------------------
+// Streaming sample preview. The frames from the In mark on are extracted a
+// few at a time from a timer on this thread and their samples are queued
+// in a SampleStream that the audio output plays, so the sound starts after a
+// few frames and goes on until stopped or the end of the source. The
+// recording buffer is rewound whenever it fills up. Parameter changes
+// apply to the frames extracted after them; the seconds heard since the
+// last change can be kept in a sample slot when the preview is stopped.
+//
+// Play is the same from the current frame, with the picture following
+// like on a flatbed. The frames ahead are decoded into the frame cache by
+// a FramePrefetcher. When the extraction cannot keep up with the sound,
+// fewer pictures are shown, down to one in PLAY_MAX_PICTURE_INTERVAL,
+// and the status bar says so.
+
+void MainWindow::StartPreview(bool play)
+{
+	if(!frame_window || !this->scan.inFile.IsReady() || extraction) return;
+
+	previewSampleRate = (ui->filerate_PD->currentIndex()+1)*48000;
+	switch(ui->filmrate_PD->currentIndex())
 	{
-		numFrames = this->scan.inFile.LastFrame() -
-				ui->frameInSpinBox->value();
+	case 0: previewSamplesPerFrame = (int) (previewSampleRate/23.976); break;
+	case 1: previewSamplesPerFrame = (int) (previewSampleRate/24.0); break;
+	default: previewSamplesPerFrame = (int) (previewSampleRate/25.0);
 	}
 
-	this->currentMeta = NULL;
+	QAudioFormat format;
+	format.setSampleRate(previewSampleRate);
+	format.setChannelCount(2);
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+	format.setSampleFormat(QAudioFormat::Float);
+	QAudioDevice device = QMediaDevices::defaultAudioOutput();
+#else
+	format.setSampleSize(32);
+	format.setSampleType(QAudioFormat::Float);
+	format.setCodec("audio/pcm");
+	QAudioDeviceInfo device = QAudioDeviceInfo::defaultOutputDevice();
+#endif
+	if(device.isNull() || !device.isFormatSupported(format))
+	{
+		QMessageBox::warning(this, "Sample Preview",
+				QString("The audio output cannot play %1 Hz stereo.").
+						arg(previewSampleRate));
+		return;
+	}
 
-	sample = Extract(qtmp.fileName(), QString(), firstFrame, numFrames, EXTRACT_LOG);
+	frame_window->overrideOverlap = 0;
 
-	static long nSample = 0;
+	extraction = ExtractionBackend::Create(frame_window, false, true,
+			scan.inFile.IsLumaOnly());
+	extraction->SetParameters(frame_window->Parameters());
+	if(!extraction->UsesWindow() && frame_window->cal_enabled)
+	{
+		float *mask = frame_window->GetCalibrationMask();
+		extraction->SetCalibrationMask(mask, frame_window->cal_points);
+		delete [] mask;
+	}
+	extraction->PrepareRecording(PREVIEW_BLOCK_FRAMES * previewSamplesPerFrame,
+			previewSamplesPerFrame);
 
-	if(sample.err == 0)
+	previewPlaying = play;
+	if(play)
+		previewFrame = ui->frame_numberSpinBox->value();
+	else
+		previewFrame = ui->frameInSpinBox->value() -
+				this->scan.inFile.FirstFrame();
+	previewPushed = 0;
+	previewEnding = false;
+	previewUnderruns = 0;
+	previewKept[0].clear();
+	previewKept[1].clear();
+
+	previewStream = new SampleStream(
+			PREVIEW_BUFFER_FRAMES * previewSamplesPerFrame, this);
+	previewStream->open(QIODevice::ReadOnly);
+
+	previewOutput = new PreviewAudioOutput(device, format, this);
+	connect(previewOutput, &PreviewAudioOutput::stateChanged,
+			this, &MainWindow::PreviewStateChanged);
+
+	previewTimer = new QTimer(this);
+	previewTimer->setTimerType(Qt::PreciseTimer);
+	connect(previewTimer, &QTimer::timeout, this, &MainWindow::PreviewStep);
+
+	if(play)
 	{
-        sample.sound = new QSoundEffect();
-        sample.sound->setSource(QUrl::fromLocalFile(qtmp.fileName()));
-		sample.sound->play();
+		previewSavedInterval = frame_window->preview_interval;
+		frame_window->preview_interval = 1;
+		playPictureInterval = 1;
+		playPictureCountdown = 0;
+		playHealthySteps = 0;
+
+		// as far ahead as fits in half the cache
+		FrameCache *frameCache = this->scan.inFile.GetFrameCache();
+		size_t frameBytes = size_t(this->scan.inFile.Width()) *
+				this->scan.inFile.Height() *
+				(this->scan.inFile.IsLumaOnly() ? 2 : 6);
+		long depth = 0;
+		if(frameCache && frameBytes)
+		{
+			depth = std::min(long(PLAY_PREFETCH_FRAMES),
+					long(frameCache->Limit() / 2 / frameBytes));
+		}
+		if(depth > 0)
+		{
+			prefetcher = new FramePrefetcher(this->scan.inFile, int(depth),
+					this);
+			connect(prefetcher, &FramePrefetcher::Failed,
+					this, &MainWindow::FrameDecodeFailed);
+			prefetcher->Advance(previewFrame);
+		}
 
-		SaveSampleDialog *save = new SaveSampleDialog(this);
-		save->setWindowTitle("Save Sample Audio");
-		save->exec();
+		ui->playButton->setText("Stop");
+		ui->playSampleButton->setEnabled(false);
+	}
+	else
+	{
+		ui->playSampleButton->setText("Stop Sample");
+		ui->playButton->setEnabled(false);
+	}
 
-		if(save->result() == QDialog::Accepted)
+	try
+	{
+		traceCurrentOperation = "Load Base Texture";
+		if(!Load_Frame_Texture(previewFrame++))
+			throw AeoException("Could not load the first frame");
+		extraction->SetRecording(true);
+	}
+	catch(std::exception &e)
+	{
+		StopPreview(false);
+		QMessageBox::warning(this, "Sample Preview",
+				QString("Error extracting sound: \n") + e.what());
+		return;
+	}
+
+	previewTimer->start(PREVIEW_INTERVAL);
+	PreviewStep();
+}
+
+void MainWindow::StopPreview(bool offerSlot)
+{
+	if(!previewStream) return;
+
+	previewTimer->stop();
+	delete previewTimer;
+	previewTimer = NULL;
+
+	// this may be called from the sink's own signal
+	previewOutput->disconnect(this);
+	previewOutput->stop();
+	previewOutput->deleteLater();
+	previewOutput = NULL;
+
+	delete previewStream;
+	previewStream = NULL;
+
+	delete prefetcher;
+	prefetcher = NULL;
+
+	try
+	{
+		extraction->DestroyRecording();
+	}
+	catch(std::exception &e)
+	{
+		Log() << "Sample preview: " << e.what() << "\n";
+	}
+	delete extraction;
+	extraction = NULL;
+
+	ui->playSampleButton->setText("New Sample");
+	ui->playSampleButton->setEnabled(true);
+	ui->playButton->setText("Play");
+	ui->playButton->setEnabled(true);
+
+	if(previewPlaying)
+	{
+		if(frame_window)
+			frame_window->preview_interval = previewSavedInterval;
+
+		// stay where the playback got to
+		long frame = std::min(std::max(previewFrame - 1, 0L),
+				long(ui->frame_numberSpinBox->maximum()));
+		if(frame != ui->frame_numberSpinBox->value())
+			ui->frame_numberSpinBox->setValue(frame);
+		else
+			ScrubToFrame(frame);
+		offerSlot = false;
+	}
+	else if(frame_window)
+		frame_window->renderLater();
+
+	if(previewUnderruns)
+	{
+		statusBar()->showMessage(
+				QString("Sample preview: extraction fell behind playback "
+						"%1 times").arg(previewUnderruns));
+	}
+
+	long n = long(previewKept[0].size());
+	n -= n % previewSamplesPerFrame;
+	if(offerSlot && n > 0)
+	{
+		float *kept[2] = { previewKept[0].data(), previewKept[1].data() };
+		QString fn = WriteSampleFile(kept, n, previewSampleRate,
+				previewSamplesPerFrame);
+		if(!fn.isEmpty())
 		{
-			switch(save->SelectedSlot())
-			{
-			case 1:
-				if(samplesPlayed[0].sound != NULL)
-					delete samplesPlayed[0].sound;
+			ExtractedSound sample = ExtractionParamsFromGUI();
+			sample.err = 0;
+			sample.sound = new QSoundEffect();
+			sample.sound->setSource(QUrl::fromLocalFile(fn));
+			OfferSampleSlot(sample);
+		}
+	}
 
-				samplesPlayed[0] = sample;
-				ui->playSample1Button->setEnabled(true);
-				ui->loadSample1Button->setEnabled(true);
-				break;
-			case 2:
-				if(samplesPlayed[1].sound != NULL)
-					delete samplesPlayed[1].sound;
+	previewKept[0].clear();
+	previewKept[1].clear();
+}
 
-				samplesPlayed[1] = sample;
-				ui->playSample2Button->setEnabled(true);
-				ui->loadSample2Button->setEnabled(true);
-				break;
-			case 3:
-				if(samplesPlayed[2].sound != NULL)
-					delete samplesPlayed[2].sound;
+void MainWindow::PreviewStep()
+{
+	if(!previewStream) return;
 
-				samplesPlayed[2] = sample;
-				ui->playSample3Button->setEnabled(true);
-				ui->loadSample3Button->setEnabled(true);
-				break;
-			case 4:
-				if(samplesPlayed[3].sound != NULL)
-					delete samplesPlayed[3].sound;
+	try
+	{
+		for(int i=0; i<PREVIEW_STEP_FRAMES; ++i)
+		{
+			// wait for playback to make room
+			if(!PushPreview()) break;
 
-				samplesPlayed[3] = sample;
-				ui->playSample4Button->setEnabled(true);
-				ui->loadSample4Button->setEnabled(true);
+			if(previewEnding)
+			{
+				previewStream->Finish();
+				previewTimer->stop();
 				break;
 			}
+
+			if(extraction->RecordingFull())
+			{
+				// the whole buffer has to be in the stream before reuse
+				extraction->FinishRecording();
+				if(!PushPreview()) break;
+				extraction->RewindRecording();
+				previewPushed = 0;
+			}
+
+			if(previewStream->Space() < previewSamplesPerFrame) break;
+
+			traceCurrentOperation = "Load Texture";
+			if(previewFrame > this->scan.inFile.NumFrames()-1)
+			{
+				// the samples of a frame come with the next one
+				if(!Load_Frame_Texture(previewFrame - 1))
+					throw AeoException("Could not load the last frame");
+				extraction->SetRecording(false);
+				extraction->FinishRecording();
+				previewEnding = true;
+			}
+			else
+			{
+				if(!Load_Frame_Texture(previewFrame))
+					throw AeoException("Could not load a frame");
+				if(previewPlaying) PlayFrameLoaded(previewFrame);
+				++previewFrame;
+			}
 		}
 	}
+	catch(std::exception &e)
+	{
+		StopPreview(false);
+		QMessageBox::warning(this, "Sample Preview",
+				QString("Error extracting sound: \n") + e.what());
+		return;
+	}
 
-	return;
+	if(previewOutput->state() == QAudio::StoppedState &&
+			previewOutput->error() == QAudio::NoError &&
+			(previewStream->Buffered() >=
+					PREVIEW_PREBUFFER_FRAMES * previewSamplesPerFrame ||
+			previewStream->Finished()))
+	{
+		previewOutput->start(previewStream);
+	}
+
+	bool underrun = previewStream->Underruns() != previewUnderruns;
+	if(underrun)
+	{
+		previewUnderruns = previewStream->Underruns();
+		statusBar()->showMessage(
+				QString("Sample preview: extraction fell behind playback "
+						"%1 times").arg(previewUnderruns));
+	}
+
+	if(previewPlaying && previewOutput->state() == QAudio::ActiveState &&
+			!previewEnding)
+	{
+		int interval = playPictureInterval;
+		if(underrun || previewStream->Buffered() <
+				PREVIEW_PREBUFFER_FRAMES * previewSamplesPerFrame)
+		{
+			// behind: give the time of pictures to the sound
+			interval = std::min(interval * 2, PLAY_MAX_PICTURE_INTERVAL);
+			playHealthySteps = 0;
+		}
+		else if(interval > 1 && ++playHealthySteps >= PLAY_RELAX_STEPS)
+		{
+			interval /= 2;
+			playHealthySteps = 0;
+		}
+
+		if(interval != playPictureInterval)
+		{
+			playPictureInterval = interval;
+			frame_window->preview_interval = interval;
+			if(interval > 1)
+			{
+				statusBar()->showMessage(
+						QString("Playback cannot keep up: showing one "
+								"frame in %1").arg(interval));
+			}
+			else
+				statusBar()->clearMessage();
+		}
+	}
+}
+
+// a frame of Play has been extracted; show it if it is its turn
+void MainWindow::PlayFrameLoaded(long frame)
+{
+	if(prefetcher) prefetcher->Advance(frame + 1);
+
+	if(playPictureCountdown-- > 0) return;
+	playPictureCountdown = playPictureInterval - 1;
+
+	// the window backends draw the picture as they extract
+	if(!extraction->UsesWindow() && currentFrameTexture)
+	{
+		frame_window->load_frame_texture(currentFrameTexture);
+		frame_window->renderLater();
+	}
+
+	const QSignalBlocker spinBlocker(ui->frame_numberSpinBox);
+	const QSignalBlocker sliderBlocker(ui->playSlider);
+	ui->frame_numberSpinBox->setValue(frame);
+	ui->playSlider->setValue(frame);
+	ui->frameNumberTimeCodeLabel->setText(Compute_Timecode_String(frame));
+}
+
+// Move the samples that are final from the recording into the stream.
+// False while some are left that do not fit yet.
+bool MainWindow::PushPreview()
+{
+	long ready = extraction->RecordedSamples();
+	extraction->ProcessRecording(ready);
+
+	float **rec = extraction->GetRecording();
+	long n = previewStream->Write(rec[0] + previewPushed,
+			rec[1] + previewPushed, ready - previewPushed);
+
+	long keep = std::min(n, long(SAMPLE_FRAMES * previewSamplesPerFrame) -
+			long(previewKept[0].size()));
+	for(int c=0; c<2 && keep>0; ++c)
+	{
+		previewKept[c].insert(previewKept[c].end(),
+				rec[c] + previewPushed, rec[c] + previewPushed + keep);
+	}
+
+	previewPushed += n;
+
+	return previewPushed == ready;
+}
+
+void MainWindow::PreviewStateChanged(QAudio::State state)
+{
+	if(!previewStream) return;
+
+	if(state == QAudio::IdleState && previewStream->atEnd())
+		StopPreview(true);
+	else if(state == QAudio::StoppedState &&
+			previewOutput->error() != QAudio::NoError)
+	{
+		StopPreview(false);
+		QMessageBox::warning(this, "Sample Preview",
+				"The audio output stopped with an error.");
+	}
+}
+
+void MainWindow::OfferSampleSlot(ExtractedSound &sample)
+{
+	SaveSampleDialog *save = new SaveSampleDialog(this);
+	save->setWindowTitle("Save Sample Audio");
+	save->exec();
+
+	if(save->result() == QDialog::Accepted)
+	{
+		switch(save->SelectedSlot())
+		{
+		case 1:
+			if(samplesPlayed[0].sound != NULL)
+				delete samplesPlayed[0].sound;
+
+			samplesPlayed[0] = sample;
+			ui->playSample1Button->setEnabled(true);
+			ui->loadSample1Button->setEnabled(true);
+			break;
+		case 2:
+			if(samplesPlayed[1].sound != NULL)
+				delete samplesPlayed[1].sound;
+
+			samplesPlayed[1] = sample;
+			ui->playSample2Button->setEnabled(true);
+			ui->loadSample2Button->setEnabled(true);
+			break;
+		case 3:
+			if(samplesPlayed[2].sound != NULL)
+				delete samplesPlayed[2].sound;
+
+			samplesPlayed[2] = sample;
+			ui->playSample3Button->setEnabled(true);
+			ui->loadSample3Button->setEnabled(true);
+			break;
+		case 4:
+			if(samplesPlayed[3].sound != NULL)
+				delete samplesPlayed[3].sound;
+
+			samplesPlayed[3] = sample;
+			ui->playSample4Button->setEnabled(true);
+			ui->loadSample4Button->setEnabled(true);
+			break;
+		}
+	}
+	else
+		delete sample.sound;
+}
+
+//----------------------------------------------------------------------------
+// Sweep: the range of a sample extracted with several parameter sets in
+// one pass. Each frame is decoded once and run through a CpuEngine per
+// set, so four sets cost one decode instead of four.
+
+void MainWindow::on_sweepButton_clicked()
+{
+	if(!frame_window || !this->scan.inFile.IsReady()) return;
+
+	QStringList names;
+	names << "Gamma" << "Gain" << "Lift" << "Threshold";
+
+	bool ok;
+	QString name = QInputDialog::getItem(this, "Sweep Samples",
+			"Fill the sample slots varying", names, 0, false, &ok);
+	if(!ok) return;
+
+	// the sets run on CpuEngines, which only match the OpenGL export on
+	// a source decoded to lightness
+	if(!this->scan.inFile.IsLumaOnly() &&
+			QMessageBox::question(this, "Sweep Samples",
+					"The sweep takes lightness before the tone curve, and "
+					"the export of a colour source takes it after, so the "
+					"samples can sound different from the export. Turn on "
+					"\"Decode scans to lightness only\" in the preferences "
+					"and open the source again for samples that match.\n\n"
+					"Sweep anyway?",
+					QMessageBox::Yes | QMessageBox::No,
+					QMessageBox::No) != QMessageBox::Yes)
+		return;
+
+	StopPreview(false);
+
+	// two steps either side of the current value
+	static const int steps[4] = { -2, -1, 1, 2 };
+	ExtractedSound current = ExtractionParamsFromGUI();
+	std::vector<ExtractedSound> sets(4, current);
+	for(int i=0; i<4; ++i)
+	{
+		ExtractedSound &s = sets[i];
+		if(name == "Gamma")
+			s.gamma = qBound(ui->gammaSlider->minimum(),
+					current.gamma + 10*steps[i], ui->gammaSlider->maximum());
+		else if(name == "Gain")
+			s.gain = qBound(ui->gainSlider->minimum(),
+					current.gain + 10*steps[i], ui->gainSlider->maximum());
+		else if(name == "Lift")
+			s.lift = qBound(ui->liftSlider->minimum(),
+					current.lift + 5*steps[i], ui->liftSlider->maximum());
+		else
+		{
+			s.useSCurve = true;
+			s.sCurve = qBound(ui->thresholdSlider->minimum(),
+					ui->thresholdSlider->value() + 10*steps[i],
+					ui->thresholdSlider->maximum());
+		}
+	}
+
+	long firstFrame = ui->frameInSpinBox->value() -
+			this->scan.inFile.FirstFrame();
+	long numFrames = std::min(long(SAMPLE_FRAMES),
+			this->scan.inFile.LastFrame() - ui->frameInSpinBox->value());
+	if(numFrames <= 0) return;
+
+	std::vector<ExtractedSound> results =
+			SweepExtract(sets, firstFrame, numFrames);
+
+	QPushButton *playButtons[4] = { ui->playSample1Button,
+			ui->playSample2Button, ui->playSample3Button,
+			ui->playSample4Button };
+	QPushButton *loadButtons[4] = { ui->loadSample1Button,
+			ui->loadSample2Button, ui->loadSample3Button,
+			ui->loadSample4Button };
+
+	for(size_t i=0; i<results.size() && i<samplesPlayed.size(); ++i)
+	{
+		if(samplesPlayed[i].sound != NULL)
+			delete samplesPlayed[i].sound;
+
+		samplesPlayed[i] = results[i];
+		playButtons[i]->setEnabled(true);
+		loadButtons[i]->setEnabled(true);
+	}
+}
+
+// The sets, each with its sound, extracted from the frames from
+// firstFrame; empty if canceled or failed. The film and sampling rates
+// are those of the GUI for all of them.
+std::vector<ExtractedSound> MainWindow::SweepExtract(
+		const std::vector<ExtractedSound> &sets, long firstFrame,
+		long numFrames)
+{
+	std::vector<ExtractedSound> results;
+	std::vector<ExtractionBackend *> backends;
+
+	int samplerate = (ui->filerate_PD->currentIndex()+1)*48000;
+	int frameratesamples;
+	switch(ui->filmrate_PD->currentIndex())
+	{
+	case 0: frameratesamples = (int) (samplerate/23.976); break;
+	case 1: frameratesamples = (int) (samplerate/24.0); break;
+	default: frameratesamples = (int) (samplerate/25.0);
+	}
+
+	QProgressDialog progress("Extracting Samples...","Cancel",0,numFrames);
+	progress.setWindowModality(Qt::WindowModal);
+	progress.setWindowTitle("Extracting Samples...");
+	progress.setMinimumDuration(0);
+
+	this->requestCancel = false;
+
+	float *mask = NULL;
+	if(frame_window->cal_enabled)
+		mask = frame_window->GetCalibrationMask();
+
+	Log() << "Sweep: " << sets.size() << " parameter sets, frames " <<
+			firstFrame << " to " << firstFrame + numFrames << "\n";
+
+	try
+	{
+		// the strip has to hold the columns of every set
+		int x0, x1;
+		ColumnsRead(frame_window->Parameters(), x0, x1);
+		for(size_t i=0; i<sets.size(); ++i)
+		{
+			int s0, s1;
+			ColumnsRead(SweepParameters(sets[i]), s0, s1);
+			x0 = std::min(x0, s0);
+			x1 = std::max(x1, s1);
+		}
+		UpdateStripCache(x0, x1);
+
+		for(size_t i=0; i<sets.size(); ++i)
+		{
+			backends.push_back(ExtractionBackend::CreateCpu());
+			static_cast<CpuBackend *>(backends[i])->SetStageCache(
+					&StageCache::Shared(), scan.inFile.CacheKey());
+			backends[i]->SetParameters(SweepParameters(sets[i]));
+			if(mask)
+				backends[i]->SetCalibrationMask(mask, frame_window->cal_points);
+			backends[i]->PrepareRecording(numFrames * frameratesamples,
+					frameratesamples);
+		}
+
+		ExtractOnWorker(progress, backends, firstFrame, numFrames);
+
+		for(size_t i=0; i<sets.size(); ++i)
+		{
+			backends[i]->ProcessRecording(numFrames * frameratesamples);
+
+			QString fn = WriteSampleFile(backends[i]->GetRecording(),
+					numFrames * frameratesamples, samplerate,
+					frameratesamples);
+			if(fn.isEmpty())
+				throw AeoException("Cannot write a sample file");
+
+			ExtractedSound sound = sets[i];
+			sound.err = 0;
+			sound.sound = new QSoundEffect();
+			sound.sound->setSource(QUrl::fromLocalFile(fn));
+			results.push_back(sound);
+		}
+	}
+	catch(int)
+	{
+		// canceled
+	}
+	catch(std::exception &e)
+	{
+		for(size_t i=0; i<results.size(); ++i)
+			delete results[i].sound;
+		results.clear();
+
+		QMessageBox::warning(this, "Sweep Samples",
+				QString("Error extracting sound: \n") + e.what());
+	}
+
+	delete [] mask;
+	for(size_t i=0; i<backends.size(); ++i)
+		delete backends[i];
+
+	return results;
+}
+
+// The window parameters with those of the set in their place, converted
+// as GPU_Params_Update() converts the controls.
+ExtractionParameters MainWindow::SweepParameters(
+		const ExtractedSound &set) const
+{
+	ExtractionParameters p = frame_window->Parameters();
+	float w = this->scan.inFile.Width();
+
+	if(set.useBounds)
+	{
+		p.bounds[0] = set.bounds[0] / w;
+		p.bounds[1] = set.bounds[1] / w;
+	}
+	if(set.usePixBounds)
+	{
+		p.pixbounds[0] = set.pixBounds[0] / w;
+		p.pixbounds[1] = set.pixBounds[1] / w;
+		p.overlap_target = set.useBounds ? 2.0 : 1.0;
+	}
+	else
+		p.overlap_target = 0.0;
+
+	p.overlap[1] = set.overlap / 100.0f;
+	p.overlap[2] = set.framePitch[1] / 1000.0f;
+	p.overlap[3] = set.framePitch[0] / 1000.0f;
+
+	p.gamma = set.gamma / 100.0f;
+	p.lift = set.lift / 100.0f;
+	p.gain = set.gain / 100.0f;
+	p.blur = set.blur / 100.0f;
+	p.thresh = set.useSCurve;
+	if(set.useSCurve) p.threshold = set.sCurve / 100.0f;
+	p.negative = set.makeNegative;
+	p.rot_angle = set.applyRotation ? set.rot_angle : 0.0f;
+
+	return p;
+}
+
+// a temporary WAV file of the samples, for a QSoundEffect; empty if it
+// cannot be written
+QString MainWindow::WriteSampleFile(float **samples, long n, int samplerate,
+		int samplesPerFrame)
+{
+	QTemporaryFile qtmp(QDir::tempPath()+"/aeoXXXXXX.wav");
+	// open and close it to ensure the name is fully resolved
+	qtmp.setAutoRemove(false);
+	qtmp.open();
+	qtmp.close();
+
+	wav wout(samplerate);
+	wout.nChannels = 2;
+	wout.samplesPerFrame = samplesPerFrame;
+	wout.bitsPerSample =
+			ui->bitDepthComboBox->currentText().split(" ")[0].toInt();
+
+	if(wout.open(qtmp.fileName().toStdString().c_str()) == NULL)
+	{
+		Log() << "Cannot write " << qtmp.fileName() << "\n";
+		return QString();
+	}
+
+	wout.writebuffer(samples, n);
+	wout.close();
+
+	return qtmp.fileName();
 }
 
 void MainWindow::on_playSample1Button_clicked()
@@ -1878,6 +2608,9 @@ ExtractedSound MainWindow::Extract(QString filename, QString videoFilename,
 	ExtractedSound ret;
 	bool success;
 
+	// the preview and the extraction cannot share the window
+	StopPreview(false);
+
 	av_log(NULL, AV_LOG_INFO, "Extract() called:\n");
 	av_log(NULL, AV_LOG_INFO, "WriteAudio: %s\n", filename.toStdString().c_str());
 	if(!videoFilename.isEmpty())
@@ -1938,39 +2671,8 @@ ExtractedSound MainWindow::Extract(QString filename, QString videoFilename,
 			this->frame_window->PrintGLVersion(Log());
 		}
 
-		if(!this->frame_window->isExposed())
-		{
-			if(flags & EXTRACT_LOG) Log() << "Frame window not exposed.\n";
-
-			this->frame_window->raise();
-			this->frame_window->showNormal();
-			this->frame_window->setWindowState(Qt::WindowActive);
-			//qApp->setActiveWindow(this->frame_window);
-
-			qApp->processEvents();
-		}
-
-		while (!this->frame_window->isExposed())
-		{
-			if(flags & EXTRACT_LOG)
-				Log() << "Frame window still not exposed. "
-						"Asking for user help.\n";
-			int raise = QMessageBox::question(this, "Select image Window",
-					"The image window is obscured. "
-					"Please move it to the front.",
-					QMessageBox::Ok | QMessageBox::Cancel,
-					QMessageBox::Ok);
-
-			if(raise == QMessageBox::Cancel)
-			{
-				if(flags & EXTRACT_LOG)
-					Log() << "User cancelled (could not raise window?)\n";
-				ret.err = 1;
-				return ret;
-			}
-		}
-
-		if(flags & EXTRACT_LOG) Log() << "Frame window is exposed.\n";
+		if(!this->frame_window->isExposed() && (flags & EXTRACT_LOG))
+			Log() << "Frame window not exposed. Rendering offscreen.\n";
 
 		void (*prevSegvHandler)(int);
 		prevSegvHandler = std::signal(SIGSEGV, SegvHandler);
@@ -1990,10 +2692,12 @@ ExtractedSound MainWindow::Extract(QString filename, QString videoFilename,
 
 		if(flags & EXTRACT_LOG) this->frame_window->logger = &Log();
 		this->frame_window->currentOperation = &traceSubroutineOperation;
+		this->frame_window->ResetPassTimes();
 
 		success = this->WriteAudioToFile(filename.toStdString().c_str(),
 				videoFilename.toStdString().c_str(),
 				firstFrame, numFrames);
+		if(flags & EXTRACT_LOG) this->frame_window->ReportPassTimes(Log());
 		this->frame_window->logger = NULL;
 		this->frame_window->currentOperation = NULL;
 
@@ -2188,7 +2892,7 @@ AVFrame *MainWindow::GetAudioFromQueue()
 	else
 	{
 		// translate the floating point values to S16:
-		float **audio = this->frame_window->FileRealBuffer;
+		float **audio = this->extraction->GetRecording();
 		av_log(NULL, AV_LOG_INFO, "audio = FileRealBuffer = [%p,%p]\n",
 				audio[0], audio[1]);
 		av_log(NULL, AV_LOG_INFO, "Audio copy nb_samples = %d x%d\n",
@@ -3221,6 +3925,85 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 
 	AudioFromTexture audio(numChannels, samplerate, frameratesamples);
 
+	ExtractionParameters params = frame_window->Parameters();
+	{
+		int x0, x1;
+		ColumnsRead(params, x0, x1);
+		UpdateStripCache(x0, x1);
+	}
+	extraction = ExtractionBackend::Create(frame_window, videoFn != NULL,
+			false, scan.inFile.IsLumaOnly());
+	extraction->SetParameters(params);
+
+	float *mask = NULL;
+	if(frame_window->cal_enabled)
+		mask = frame_window->GetCalibrationMask();
+	if(mask && !extraction->UsesWindow())
+		extraction->SetCalibrationMask(mask, frame_window->cal_points);
+
+	CpuBackend *cpu = dynamic_cast<CpuBackend *>(extraction);
+	if(cpu)
+		cpu->SetStageCache(&StageCache::Shared(), scan.inFile.CacheKey());
+
+	// what the samples before the DSP depend on
+	bool fixedPoint =
+			QSettings().value("extraction/fixed-point", false).toBool();
+	quint64 recordingKey = StageCache::RecordingKey(
+			StageCache::RowsKey(scan.inFile.CacheKey(), params, fixedPoint,
+					mask, frame_window->cal_points),
+			params, extraction->Name(), extraction->TracksPitch(),
+			frameratesamples, firstFrame, numFrames);
+	delete [] mask;
+
+	Log() << "Extraction backend: " << extraction->Name() << "\n";
+
+	// the overlap of every frame is saved next to the sound file; a map
+	// saved there before, with the corrections made to it, can be used
+	// instead of searching again
+	QString mapFn = OverlapMap::FileFor(QString::fromUtf8(fn));
+	bool reuseOverlap = false;
+	if(ui->overlapMapCheckBox->isChecked())
+	{
+		overlapMapKey = 0;
+		if(overlapMap->Load(mapFn, scan.inFile.NumFrames()))
+		{
+			int corrected = overlapMap->LoadCorrections(
+					OverlapMap::CorrectionsFor(QString::fromUtf8(fn)));
+			Log() << "Overlap map: " << mapFn << ", " <<
+					std::max(corrected, 0) << " corrections\n";
+			// the positions still hold if the errors were measured
+			// otherwise, but the errors are not kept alongside new ones
+			if(overlapMap->Metric() != extraction->ErrorMetric())
+				Log() << "Overlap map errors were measured by another "
+						"search; only its positions are used\n";
+			overlapMap->SetMetric(extraction->ErrorMetric());
+			reuseOverlap = true;
+		}
+		else
+			Log() << "No overlap map of this source in " << mapFn <<
+					"; searching\n";
+	}
+	// the map of the last run still goes with its recording
+	if(!reuseOverlap && overlapMapKey != recordingKey)
+	{
+		overlapMap->Reset(scan.inFile.NumFrames(),
+				frame_window->samplesperframe,
+				extraction->ErrorMetric());
+		overlapMapKey = 0;
+	}
+	extraction->SetOverlapMap(overlapMap, reuseOverlap);
+
+	// a sample fits in the frame cache; a whole reel would only push out
+	// the frames being tuned, so it just takes the ones already there
+	FrameCache *frameCache = scan.inFile.GetFrameCache();
+	if(frameCache)
+	{
+		size_t frameBytes = size_t(scan.inFile.Width()) *
+				scan.inFile.Height() * (scan.inFile.IsLumaOnly() ? 2 : 6);
+		scan.inFile.SetFrameCache(frameCache,
+				size_t(numFrames) * frameBytes <= frameCache->Limit() / 2);
+	}
+
 	outputFrameTexture= new FrameTexture();
 	outputFrameTexture->width=640;
 	outputFrameTexture->height=480;
@@ -3284,8 +4067,8 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 	strncpy(wout.OriginationTime,
 			qPrintable(QDateTime::currentDateTime().toString("hh:mm:ss")),8);
 
-	frame_window->samplesperframe_file =frameratesamples;
-	frame_window->PrepareRecording(numFrames * frameratesamples);
+	extraction->PrepareRecording(numFrames * frameratesamples,
+			frameratesamples);
 
 	try
 	{
@@ -3300,10 +4083,6 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 		}
 		#endif
 
-		traceCurrentOperation = "Load Base Texture";
-		if(!Load_Frame_Texture(firstFrame + 0)) throw 1;
-		frame_window->is_rendering=true;
-
 		unsigned int sec;
 		unsigned int frames;
         QStringList TCL = this->scan.inFile.TimeCode.split(
@@ -3315,8 +4094,35 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 		frames= frames%fps_timbase;
 		wout.set_timecode(sec,frames);
 
-		traceCurrentOperation = "Load Texture";
-		if(!Load_Frame_Texture(firstFrame + 1)) throw 1;
+		// nothing the samples depend on has changed since the last run:
+		// only the DSP and the file are done again
+		bool reuse = !videoFn && !reuseOverlap &&
+				overlapMapKey == recordingKey &&
+				StageCache::Shared().GetRecording(recordingKey,
+						extraction->GetRecording(),
+						numFrames * frameratesamples);
+
+		// without a video output or the image window, the frames are
+		// processed on a worker thread and the GUI stays live
+		bool onWorker = !videoFn && !extraction->UsesWindow();
+		if(reuse)
+		{
+			Log() << "Reusing the samples of the previous extraction\n";
+			progress.setValue(numFrames);
+		}
+		else if(onWorker)
+			ExtractOnWorker(progress,
+					std::vector<ExtractionBackend *>(1, extraction),
+					firstFrame, numFrames);
+		else
+		{
+			traceCurrentOperation = "Load Base Texture";
+			if(!Load_Frame_Texture(firstFrame + 0)) throw 1;
+			extraction->SetRecording(true);
+
+			traceCurrentOperation = "Load Texture";
+			if(!Load_Frame_Texture(firstFrame + 1)) throw 1;
+		}
 
 		#ifdef USE_MUX_HACK
 		if(videoFn)
@@ -3328,7 +4134,10 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 		}
 		else
 		#endif
+		if(!onWorker && !reuse)
 		{
+			QElapsedTimer rate;
+			rate.start();
 			for (long a = 2; a<= numFrames; a++)
 			{
 				traceCurrentOperation = "Load Texture";\
@@ -3348,17 +4157,17 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 				vid.WriteVideoFrame(this->outputFrameTexture);
 				#endif
 
-				audio.buf[0] = frame_window->FileRealBuffer[0] +
+				audio.buf[0] = extraction->GetRecording()[0] +
 						(a-2)*frameratesamples;
 				if(audio.nChannels == 2)
 				{
-					audio.buf[1] = frame_window->FileRealBuffer[1] +
+					audio.buf[1] = extraction->GetRecording()[1] +
 							(a-2)*frameratesamples;
 				}
 
 				av_log(NULL, AV_LOG_INFO, "audio.buf from FileRealBuffer = [%p,%p]\n",
-						frame_window->FileRealBuffer[0],
-						frame_window->FileRealBuffer[1]);
+						extraction->GetRecording()[0],
+						extraction->GetRecording()[1]);
 				av_log(NULL, AV_LOG_INFO, "offset of %ld*%d yeilds buf = [%p,%p]\n",
 						(a-2),frameratesamples, audio.buf[0], audio.buf[1]);
 
@@ -3369,6 +4178,9 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 				traceCurrentOperation = "Update Progress Bar";
 
 				progress.setValue(a);
+				progress.setLabelText("Audio Rendering... " +
+						ExtractionWorker::Throughput(a, numFrames,
+								rate.elapsed() / 1.0e3));
 				traceCurrentOperation = "Process GUI events";
 
 				if(progress.wasCanceled())
@@ -3381,12 +4193,20 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 			}
 		}
 
-		frame_window->is_rendering =false;
+		extraction->SetRecording(false);
+		traceCurrentOperation = "Finish Recording";
+		extraction->FinishRecording();
+		if(!reuse && !videoFn && !reuseOverlap)
+		{
+			StageCache::Shared().PutRecording(recordingKey,
+					extraction->GetRecording(),
+					numFrames * frameratesamples);
+		}
 		traceCurrentOperation = "Process Recording";
-		frame_window->ProcessRecording(numFrames * frameratesamples);
+		extraction->ProcessRecording(numFrames * frameratesamples);
 
 		traceCurrentOperation = "Writing wav file";
-		wout.writebuffer(frame_window->FileRealBuffer,
+		wout.writebuffer(extraction->GetRecording(),
 				numFrames * frameratesamples);
 
 		// INFO chunk
@@ -3409,6 +4229,19 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 
 		traceCurrentOperation = "Closing wav file";
 		wout.close();
+
+		traceCurrentOperation = "Writing overlap map";
+		if(!reuseOverlap) overlapMapKey = recordingKey;
+		if(overlapMap->Save(mapFn))
+		{
+			std::vector<long> iffy = overlapMap->IffyFrames();
+			Log() << "Overlap map: " << iffy.size() << " iffy frames";
+			for(size_t i=0; i<iffy.size() && i<100; ++i)
+				Log() << (i ? ", " : ": ") << iffy[i];
+			Log() << (iffy.size() > 100 ? ", ...\n" : "\n");
+		}
+		else
+			Log() << "Cannot write the overlap map " << mapFn << "\n";
 		traceCurrentOperation = "";
 
 		#ifndef USE_MUX_HACK
@@ -3423,13 +4256,21 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 	}
 	catch(...)
 	{
+		delete extraction;
+		extraction = NULL;
+		scan.inFile.SetFrameCache(frameCache);
 		throw;
 	}
 
 	// clean up:
 
-	frame_window->is_rendering =false;
-	frame_window->DestroyRecording();
+	extraction->DestroyRecording();
+	delete extraction;
+	extraction = NULL;
+	scan.inFile.SetFrameCache(frameCache);
+
+	// previews were decimated; show where extraction stopped
+	frame_window->renderNow();
 
 	if(this->requestCancel)
 		ret = false;
@@ -3437,6 +4278,50 @@ bool MainWindow::WriteAudioToFile(const char *fn, const char *videoFn,
 	return ret;
 }
 
+// The frame loop of WriteAudioToFile() on an ExtractionWorker. The GUI
+// thread waits in an event loop, so it keeps repainting and a cancel
+// stops the worker after its current frame; throws 2 when canceled, as
+// the loop on the GUI thread does.
+void MainWindow::ExtractOnWorker(QProgressDialog &progress,
+		const std::vector<ExtractionBackend *> &backends,
+		long firstFrame, long numFrames)
+{
+	ExtractionWorker worker(this->scan.inFile, backends, firstFrame,
+			numFrames);
+	QEventLoop loop;
+
+	connect(&worker, &ExtractionWorker::Progress, &progress,
+			[&progress, numFrames](long done, double fps, double) {
+				progress.setValue(done);
+				progress.setLabelText("Audio Rendering... " +
+						ExtractionWorker::Throughput(done, numFrames,
+								done / fps));
+			});
+	connect(&progress, &QProgressDialog::canceled, &worker,
+			[&worker]() { worker.Cancel(); });
+	connect(&worker, &QThread::finished, &loop, &QEventLoop::quit);
+
+	// frames loaded for display meanwhile must not reach the backend
+	ExtractionBackend *backend = extraction;
+	extraction = NULL;
+
+	traceCurrentOperation = "Extracting on worker thread";
+	worker.start();
+	loop.exec();
+	worker.wait();
+	traceCurrentOperation = "";
+
+	extraction = backend;
+
+	if(worker.Canceled())
+	{
+		this->requestCancel = true;
+		throw 2;
+	}
+	if(!worker.Error().isEmpty())
+		throw AeoException(worker.Error());
+}
+
 //*********************IMAGE PROCESSING UI ************************************
 QString MainWindow::Compute_Timecode_String(int position)
 {
@@ -4356,6 +5241,166 @@ void MainWindow::on_actionPreferences_triggered()
 	delete pref;
 }
 
+// The columns of the scan an extraction with p reads, in pixels: the
+// sound and picture bounds, widened by how far the rotation moves them
+// and by the filter taps. The shader rotates normalised coordinates about
+// the centre, so the rows at the top and bottom move by half the sine of
+// the angle times the width.
+void MainWindow::ColumnsRead(const ExtractionParameters &p, int &x0,
+		int &x1) const
+{
+	int w = this->scan.inFile.Width();
+	float u0 = std::min(p.bounds[0], p.pixbounds[0]);
+	float u1 = std::max(p.bounds[1], p.pixbounds[1]);
+
+	double a = 3.1415926 * p.rot_angle / 180.0;
+	double c = std::cos(a);
+	double s = std::fabs(std::sin(a));
+	double e0 = 0.5 + (u0 - 0.5)*c;
+	double e1 = 0.5 + (u1 - 0.5)*c;
+
+	x0 = int(std::floor((std::min(e0, e1) - 0.5*s) * w)) - STRIP_TAP_MARGIN;
+	x1 = int(std::ceil((std::max(e0, e1) + 0.5*s) * w)) + STRIP_TAP_MARGIN;
+	x0 = std::max(x0, 0);
+	x1 = std::min(x1, w);
+}
+
+// The source reads from the strip cache only while it holds columns x0
+// to x1; otherwise the columns outside it would come out black and the
+// extraction silent. The frame loader has its own copy of the source, so
+// it is made again when that changes.
+void MainWindow::UpdateStripCache(int x0, int x1)
+{
+	bool use = stripCache->IsOpen() &&
+			stripCache->Left() <= x0 && stripCache->Right() >= x1;
+	if(use == (this->scan.inFile.GetStripCache() != NULL)) return;
+
+	bool loader = (frameLoader != NULL);
+	delete frameLoader;
+	frameLoader = NULL;
+
+	this->scan.inFile.SetStripCache(use ? stripCache : NULL);
+	if(loader) NewFrameLoader();
+
+	if(!use)
+	{
+		Log() << "Strip cache holds columns " << stripCache->Left() <<
+				" to " << stripCache->Right() << ", the bounds need " <<
+				x0 << " to " << x1 << ": reading the source\n";
+		statusBar()->showMessage("The bounds reach outside the strip cache; "
+				"frames are read from the source", 5000);
+	}
+}
+
+void MainWindow::NewFrameLoader()
+{
+	frameLoader = new FrameLoader(this->scan.inFile, this);
+	connect(frameLoader, &FrameLoader::Loaded,
+			this, &MainWindow::ShowLoadedFrame);
+	connect(frameLoader, &FrameLoader::Failed,
+			this, &MainWindow::FrameDecodeFailed);
+}
+
+// Copy the soundtrack and picture columns of every frame to a local file
+// once, so extractions, previews and calibrations stop reading the source.
+// A build that is canceled keeps the frames it stored and goes on from
+// there next time, as long as the columns still fit the strip.
+void MainWindow::on_actionBuild_Strip_Cache_triggered()
+{
+	if(!frame_window || !this->scan.inFile.IsReady()) return;
+
+	int w = this->scan.inFile.Width();
+	int margin = w / 20;
+	int x0, x1;
+	ColumnsRead(frame_window->Parameters(), x0, x1);
+	x0 = std::max(x0 - margin, 0);
+	x1 = std::min(x1 + margin, w);
+
+	StopPreview(false);
+
+	// nothing may read the strip while it is replaced or written
+	delete frameLoader;
+	frameLoader = NULL;
+	this->scan.inFile.SetStripCache(NULL);
+
+	QString fn = StripCache::FileFor(this->scan.inFile.GetFileName());
+	bool fits = stripCache->IsOpen() &&
+			stripCache->Left() <= x0 && stripCache->Right() >= x1;
+	if(!fits && !stripCache->Create(fn, this->scan.inFile, x0, x1))
+	{
+		QMessageBox::warning(this, "Strip Cache",
+				QString("Cannot create the strip cache in\n%1").arg(fn));
+	}
+
+	long numFrames = this->scan.inFile.NumFrames();
+	QString error;
+
+	if(stripCache->IsOpen())
+	{
+		QProgressDialog progress("Building strip cache...", "Cancel", 0,
+				int(numFrames), this);
+		progress.setWindowModality(Qt::WindowModal);
+		progress.setMinimumDuration(0);
+
+		int nThreads = std::max(1, std::min(QThread::idealThreadCount(), 8));
+		long chunk = (numFrames + nThreads - 1) / nThreads;
+		QAtomicInt done(0);
+		std::vector<StripBuilder *> builders;
+		QEventLoop loop;
+		QTimer poll;
+		int running = 0;
+
+		for(long first = 0; first < numFrames; first += chunk)
+		{
+			StripBuilder *b = new StripBuilder(this->scan.inFile, stripCache,
+					first, chunk, &done);
+			connect(b, &QThread::finished, &loop, [&loop, &running]() {
+						if(--running == 0) loop.quit();
+					});
+			connect(&progress, &QProgressDialog::canceled, b,
+					[b]() { b->Cancel(); });
+			builders.push_back(b);
+			++running;
+		}
+		connect(&poll, &QTimer::timeout, &progress, [&progress, &done]() {
+					progress.setValue(done.loadRelaxed());
+				});
+
+		traceCurrentOperation = "Building strip cache";
+		for(size_t i=0; i<builders.size(); ++i) builders[i]->start();
+		poll.start(100);
+		loop.exec();
+		poll.stop();
+		traceCurrentOperation = "";
+
+		for(size_t i=0; i<builders.size(); ++i)
+		{
+			builders[i]->wait();
+			if(error.isEmpty()) error = builders[i]->Error();
+			delete builders[i];
+		}
+		progress.setValue(int(numFrames));
+
+		this->scan.inFile.SetStripCache(stripCache);
+	}
+
+	// decoded frames from before the strip are keyed apart from its own
+	NewFrameLoader();
+
+	if(!error.isEmpty())
+		QMessageBox::warning(this, "Strip Cache", error);
+	else if(stripCache->IsOpen() && !this->scan.inFile.IsLumaOnly())
+		QMessageBox::information(this, "Strip Cache", "The strip cache "
+				"holds lightness and is read when scans are decoded to "
+				"lightness only (Preferences), from the next time the "
+				"source is opened.");
+	else if(stripCache->IsOpen())
+		statusBar()->showMessage(QString("Strip cache holds %1 of %2 "
+				"frames, columns %3 to %4").arg(stripCache->Frames()).
+				arg(numFrames).arg(stripCache->Left()).
+				arg(stripCache->Right()));
+}
+
 void MainWindow::on_actionReport_or_track_an_issue_triggered()
 {
 	QDesktopServices::openUrl(QUrl("https://github.com/usc-imi/aeo-light/issues"));
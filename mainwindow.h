@@ -25,6 +25,7 @@
 #define MAINWINDOW_H
 #include <QMainWindow>
 #include <QSoundEffect>
+#include <QAudio>
 #include <QDate>
 #include <QProgressDialog>
 #include <vector>
@@ -42,6 +43,22 @@ namespace Ui {
 class MainWindow;
 }
 
+class FrameLoader;
+class SampleStream;
+class FramePrefetcher;
+class StripCache;
+class OverlapMap;
+class QTimer;
+
+// the class that plays a QIODevice on an audio device
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+class QAudioSink;
+typedef QAudioSink PreviewAudioOutput;
+#else
+class QAudioOutput;
+typedef QAudioOutput PreviewAudioOutput;
+#endif
+
 #define FPS_NTSC 0
 #define FPS_24 1
 #define FPS_25 2
@@ -53,6 +70,18 @@ class MainWindow;
 #define EXTRACT_LOG 0x02
 #define EXTRACT_NOTIFY 0x04
 
+// streaming sample preview, in frames
+#define SAMPLE_FRAMES (24*5) // kept for a sample slot
+#define PREVIEW_BLOCK_FRAMES 48 // recording buffer, reused
+#define PREVIEW_BUFFER_FRAMES 8 // queued for playback at most
+#define PREVIEW_PREBUFFER_FRAMES 3 // queued before playback starts
+#define PREVIEW_STEP_FRAMES 4 // extracted per step at most
+#define PREVIEW_INTERVAL 10 // ms between steps
+#define PLAY_PREFETCH_FRAMES 24 // decoded ahead of Play
+#define PLAY_MAX_PICTURE_INTERVAL 24 // frames per picture when far behind
+#define PLAY_RELAX_STEPS 50 // steps without falling behind to show more
+#define STRIP_TAP_MARGIN 6 // columns the shader's filters reach past bounds
+
 
 
 class ExtractedSound
@@ -153,6 +182,18 @@ private slots:
 	void LicenseAgreement();
 	bool WriteAudioToFile(const char *fn, const char *videoFn,
 			long firstFrame, long numFrames);
+	void ExtractOnWorker(QProgressDialog &progress,
+			const std::vector<ExtractionBackend *> &backends,
+			long firstFrame, long numFrames);
+	std::vector<ExtractedSound> SweepExtract(
+			const std::vector<ExtractedSound> &sets,
+			long firstFrame, long numFrames);
+	ExtractionParameters SweepParameters(const ExtractedSound &set) const;
+	void ColumnsRead(const ExtractionParameters &p, int &x0, int &x1) const;
+	void UpdateStripCache(int x0, int x1);
+	void NewFrameLoader();
+	QString WriteSampleFile(float **samples, long n, int samplerate,
+			int samplesPerFrame);
 	void DeleteTempSoundFile(void);
 	void on_sourceButton_clicked();
 	bool saveproject(QString);
@@ -169,6 +210,9 @@ private slots:
 	void OpenStartingProject();
 	bool NewSource(QString fn, SourceFormat ft=SOURCE_UNKNOWN);
 	bool Load_Frame_Texture(int);
+	void ScrubToFrame(int frame_num);
+	void ShowLoadedFrame();
+	void FrameDecodeFailed(QString message);
 	void GPU_Params_Update(bool renderyes);
 	void UpdateQueueWidgets(void);
 	QString Compute_Timecode_String(int position);
@@ -242,6 +286,15 @@ private slots:
 	void on_frame_numberSpinBox_editingFinished();
 	void on_frameOutSpinBox_valueChanged(int arg1);
 	void on_playSampleButton_clicked();
+	void on_playButton_clicked();
+	void on_sweepButton_clicked();
+	void StartPreview(bool play);
+	void StopPreview(bool offerSlot);
+	void PreviewStep();
+	bool PushPreview();
+	void PreviewStateChanged(QAudio::State state);
+	void PlayFrameLoaded(long frame);
+	void OfferSampleSlot(ExtractedSound &sample);
 	void on_playSample1Button_clicked();
 	void on_playSample2Button_clicked();
 	void on_playSample3Button_clicked();
@@ -279,6 +332,8 @@ private slots:
 
 	void on_actionPreferences_triggered();
 
+	void on_actionBuild_Strip_Cache_triggered();
+
 	void on_actionReport_or_track_an_issue_triggered();
 
 	void on_OverlapPixCheckBox_clicked(bool checked);
@@ -291,6 +346,7 @@ private:
 	QString startingProjectFilename;
 	Ui::MainWindow *ui;
 	Frame_Window * frame_window = NULL;
+	ExtractionBackend *extraction = NULL; // set while writing a file
 	QTextStream log;
 	bool paramCopyLock;
 	bool requestCancel;
@@ -299,6 +355,28 @@ private:
 	MetaData *currentMeta;
 	FrameTexture *currentFrameTexture;
 	FrameTexture *outputFrameTexture;
+	FrameLoader *frameLoader;
+
+	// streaming sample preview; extraction is set while it runs
+	SampleStream *previewStream;
+	PreviewAudioOutput *previewOutput;
+	QTimer *previewTimer;
+	int previewSampleRate;
+	int previewSamplesPerFrame;
+	long previewFrame; // next frame to extract
+	long previewPushed; // samples of the recording in the stream
+	bool previewEnding; // all frames are extracted
+	int previewUnderruns;
+	std::vector<float> previewKept[2]; // heard since the last change
+	bool previewPlaying; // Play rather than a sample
+	int previewSavedInterval; // of the window, while playing
+	int playPictureInterval; // frames per picture shown
+	int playPictureCountdown;
+	int playHealthySteps;
+	FramePrefetcher *prefetcher;
+	StripCache *stripCache; // of the source, if one was built
+	OverlapMap *overlapMap; // of the last extraction
+	quint64 overlapMapKey; // StageCache recording it goes with, or 0
 	bool isVideoMuxingRisky;
 
 public:
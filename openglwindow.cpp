@@ -27,6 +27,7 @@
 #include <QDebug>
 
 #include <QtGui/QOpenGLContext>
+#include <QtGui/QOffscreenSurface>
 #include <QOpenGLPaintDevice>
 #include <QtGui/QPainter>
 
@@ -34,8 +35,12 @@ OpenGLWindow::OpenGLWindow(QWindow *parent)
 	: QWindow(parent)
 	, m_update_pending(false)
 	, m_animating(false)
+	, m_rendered(false)
+	, m_offscreen_render(false)
+	, m_skip_swap(false)
 	, m_context(0)
 	, m_device(0)
+	, m_offscreen(0)
 {
 	/*
 	this->format().setProfile(QSurfaceFormat::CoreProfile);
@@ -47,6 +52,7 @@ OpenGLWindow::OpenGLWindow(QWindow *parent)
 OpenGLWindow::~OpenGLWindow()
 {
 	delete m_device;
+	delete m_offscreen;
 }
 void OpenGLWindow::render(QPainter *painter)
 {
@@ -74,7 +80,11 @@ void OpenGLWindow::renderLater()
 {
 	if (!m_update_pending) {
 		m_update_pending = true;
-		QCoreApplication::postEvent(this, new QEvent(QEvent::UpdateRequest));
+		// on screen the request is paced to the display refresh
+		if (isExposed())
+			requestUpdate();
+		else
+			QCoreApplication::postEvent(this, new QEvent(QEvent::UpdateRequest));
 	}
 }
 
@@ -99,36 +109,70 @@ void OpenGLWindow::exposeEvent(QExposeEvent *event)
         renderNow();
 }
 
+// When the window is hidden, minimized or on another desktop the context
+// is made current on an offscreen surface instead, so the FBO passes (and
+// with them extraction) keep running; nothing is swapped to the screen.
 void OpenGLWindow::renderNow()
 {
-	if (!isExposed())
-		return;
-
 	bool needsInitialize = false;
 
+	m_rendered = false;
+
 	if (!m_context) {
 		m_context = new QOpenGLContext(this);
 		m_context->setFormat(requestedFormat());
-		m_context->create();
+		if (!m_context->create())
+		{
+			qWarning() << "Could not create OpenGL context";
+			delete m_context;
+			m_context = 0;
+			return;
+		}
 
 		needsInitialize = true;
 	}
 
-	m_context->makeCurrent(this);
+	if (!makeContextCurrent())
+		return;
 
 	if (needsInitialize) {
 		initializeOpenGLFunctions();
 		initialize();
 	}
 
+	m_skip_swap = false;
 	render();
+	m_rendered = true;
 
-	m_context->swapBuffers(this);
+	if (!m_offscreen_render && !m_skip_swap)
+		m_context->swapBuffers(this);
 
 	if (m_animating)
 		renderLater();
 }
 
+bool OpenGLWindow::makeContextCurrent()
+{
+	if (!m_context)
+		return false;
+
+	m_offscreen_render = !isExposed();
+
+	if (m_offscreen_render)
+	{
+		if (!m_offscreen)
+		{
+			m_offscreen = new QOffscreenSurface(screen());
+			m_offscreen->setFormat(m_context->format());
+			m_offscreen->create();
+		}
+
+		return m_offscreen->isValid() && m_context->makeCurrent(m_offscreen);
+	}
+
+	return m_context->makeCurrent(this);
+}
+
 void OpenGLWindow::setAnimating(bool animating)
 {
 	m_animating = animating;
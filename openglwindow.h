@@ -31,6 +31,7 @@
 class QPainter;
 class QOpenGLContext;
 class QOpenGLPaintDevice;
+class QOffscreenSurface;
 
 class OpenGLWindow : public QWindow, protected QOpenGLFunctions
 {
@@ -50,6 +51,12 @@ public:
 	QString GLVersionString();
 	int MajorVersion() {return m_context->format().majorVersion();}
 
+	// true if the last renderNow() got as far as render()
+	bool rendered() const { return m_rendered; }
+	// make the context current for GL work outside render(); false if
+	// there is no context yet
+	bool makeContextCurrent();
+
 public slots:
 	void renderLater();
 	void renderNow();
@@ -59,12 +66,22 @@ protected:
 
 	void exposeEvent(QExposeEvent *event) Q_DECL_OVERRIDE;
 
+	// render() is drawing without a window: the default framebuffer is
+	// not shown and may not exist, so only FBO passes are useful
+	bool isOffscreen() const { return m_offscreen_render; }
+	// set by render() when it drew nothing to the default framebuffer, so
+	// the stale back buffer is not swapped to the screen
+	bool m_skip_swap;
+
 private:
 	bool m_update_pending;
 	bool m_animating;
+	bool m_rendered;
+	bool m_offscreen_render;
 
 	QOpenGLContext *m_context;
 	QOpenGLPaintDevice *m_device;
+	QOffscreenSurface *m_offscreen;
 };
 
 #endif
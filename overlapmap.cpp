@@ -0,0 +1,242 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "overlapmap.h"
+
+#include <cstring>
+
+#include <QDataStream>
+#include <QFile>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QTextStream>
+
+#define OVERLAP_MAP_MAGIC "AEOOVLP1"
+#define OVERLAP_MAP_VERSION 2 // 1 had no metric; its errors are squared
+
+// entry flags in the file
+#define ENTRY_FOUND 1
+#define ENTRY_IFFY 2
+#define ENTRY_EDITED 4
+
+// bytes in the file: magic, version, samples per frame, frames and
+// (from version 2) the metric, then position, subsample, error and flags
+// per frame
+#define HEADER_BYTES_V1 (8 + 4 + 4 + 8)
+#define HEADER_BYTES (HEADER_BYTES_V1 + 4)
+#define ENTRY_BYTES (4 + 4 + 4 + 1)
+
+OverlapMap::OverlapMap()
+{
+	samplesPerFrame = 2000;
+	metric = OVERLAP_ERROR_SQUARED;
+}
+
+void OverlapMap::Reset(long numFrames, int n, int m)
+{
+	Entry none;
+	none.match.postion = 0;
+	none.match.value = 0;
+	none.match.subsample = 0;
+	none.found = none.iffy = none.edited = false;
+
+	entries.assign(numFrames, none);
+	samplesPerFrame = n;
+	metric = m;
+}
+
+void OverlapMap::SetMetric(int m)
+{
+	if(m == metric) return;
+
+	for(size_t f=0; f<entries.size(); ++f)
+		entries[f].match.value = -1;
+	metric = m;
+}
+
+bool OverlapMap::Has(long frame) const
+{
+	return frame >= 0 && frame < NumFrames() && entries[frame].found;
+}
+
+OverlapMap::Entry OverlapMap::Get(long frame, int n) const
+{
+	Entry e = entries[frame];
+	if(n != samplesPerFrame)
+	{
+		float pos = (e.match.postion + e.match.subsample) * n /
+				samplesPerFrame;
+		e.match.postion = int(pos + 0.5f);
+		e.match.subsample = pos - e.match.postion;
+	}
+
+	return e;
+}
+
+void OverlapMap::Set(long frame, const OverlapMatch &match, bool iffy)
+{
+	if(frame < 0 || frame >= NumFrames()) return;
+
+	Entry &e = entries[frame];
+	e.match = match;
+	e.found = true;
+	e.iffy = iffy;
+	e.edited = false;
+}
+
+bool OverlapMap::Correct(long frame, float position)
+{
+	// also false for NaN
+	if(frame < 0 || frame >= NumFrames() ||
+			!(position >= 0 && position <= samplesPerFrame))
+		return false;
+
+	Entry &e = entries[frame];
+	e.match.postion = int(position + 0.5f);
+	e.match.subsample = position - e.match.postion;
+	e.found = true;
+	e.iffy = false;
+	e.edited = true;
+	return true;
+}
+
+std::vector<long> OverlapMap::IffyFrames() const
+{
+	std::vector<long> iffy;
+	for(long f=0; f<NumFrames(); ++f)
+		if(entries[f].found && entries[f].iffy) iffy.push_back(f);
+
+	return iffy;
+}
+
+bool OverlapMap::Save(const QString &fn) const
+{
+	QFile file(fn);
+	if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) return false;
+
+	QDataStream out(&file);
+	out.setByteOrder(QDataStream::LittleEndian);
+	out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+	out.writeRawData(OVERLAP_MAP_MAGIC, 8);
+	out << quint32(OVERLAP_MAP_VERSION) << qint32(samplesPerFrame) <<
+			qint64(NumFrames()) << qint32(metric);
+
+	for(long f=0; f<NumFrames(); ++f)
+	{
+		const Entry &e = entries[f];
+		quint8 flags = (e.found ? ENTRY_FOUND : 0) |
+				(e.iffy ? ENTRY_IFFY : 0) | (e.edited ? ENTRY_EDITED : 0);
+		out << qint32(e.match.postion) << e.match.subsample <<
+				e.match.value << flags;
+	}
+
+	return out.status() == QDataStream::Ok;
+}
+
+bool OverlapMap::Load(const QString &fn, long frames)
+{
+	QFile file(fn);
+	if(!file.open(QIODevice::ReadOnly)) return false;
+
+	QDataStream in(&file);
+	in.setByteOrder(QDataStream::LittleEndian);
+	in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+	char magic[8];
+	quint32 version;
+	qint32 n;
+	qint64 numFrames;
+	qint32 m = OVERLAP_ERROR_SQUARED;
+
+	if(in.readRawData(magic, 8) != 8 ||
+			memcmp(magic, OVERLAP_MAP_MAGIC, 8)) return false;
+	in >> version >> n >> numFrames;
+	if(version == OVERLAP_MAP_VERSION) in >> m;
+	qint64 header = version == 1 ? HEADER_BYTES_V1 : HEADER_BYTES;
+	if(in.status() != QDataStream::Ok || version < 1 ||
+			version > OVERLAP_MAP_VERSION || n <= 0 ||
+			numFrames != frames ||
+			(m != OVERLAP_ERROR_SQUARED && m != OVERLAP_ERROR_ABSOLUTE) ||
+			file.size() != header + numFrames * ENTRY_BYTES)
+		return false;
+
+	std::vector<Entry> loaded(numFrames);
+	for(qint64 f=0; f<numFrames; ++f)
+	{
+		qint32 pos;
+		quint8 flags;
+		in >> pos >> loaded[f].match.subsample >> loaded[f].match.value >>
+				flags;
+		loaded[f].match.postion = pos;
+		loaded[f].found = (flags & ENTRY_FOUND) != 0;
+		loaded[f].iffy = (flags & ENTRY_IFFY) != 0;
+		loaded[f].edited = (flags & ENTRY_EDITED) != 0;
+
+		// a position outside the frame is a damaged file
+		if(loaded[f].found && (pos < 0 || pos > n)) return false;
+	}
+	if(in.status() != QDataStream::Ok) return false;
+
+	entries.swap(loaded);
+	samplesPerFrame = n;
+	metric = m;
+	return true;
+}
+
+int OverlapMap::LoadCorrections(const QString &fn)
+{
+	QFile file(fn);
+	if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) return -1;
+
+	QTextStream in(&file);
+	int applied = 0;
+	while(!in.atEnd())
+	{
+		QString line = in.readLine().trimmed();
+		if(line.isEmpty() || line.startsWith('#')) continue;
+
+		QStringList fields = line.split(QRegularExpression("[\\s,]+"),
+				Qt::SkipEmptyParts);
+		bool okFrame = false, okPos = false;
+		long frame = fields.size() >= 2 ? fields[0].toLong(&okFrame) : -1;
+		float pos = fields.size() >= 2 ? fields[1].toFloat(&okPos) : 0;
+		// frames and positions outside the map are ignored
+		if(okFrame && okPos && Correct(frame, pos)) ++applied;
+	}
+
+	return applied;
+}
+
+bool OverlapMap::Iffy(const OverlapMatch &best, int n, const float *overlap,
+		bool calc)
+{
+	int lo[OVERLAP_WINDOWS], hi[OVERLAP_WINDOWS];
+	OverlapSearch::SearchWindows(n, overlap, lo, hi);
+
+	// the window FindBestMatch() took the match from
+	int w = calc ? 1 : OVERLAP_WINDOWS-1;
+	if(hi[w] <= lo[w]) w = 0;
+
+	return best.postion <= lo[w]+1 || best.postion >= hi[w];
+}
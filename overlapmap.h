@@ -0,0 +1,99 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef OVERLAPMAP_H
+#define OVERLAPMAP_H
+
+#include <vector>
+
+#include <QString>
+
+#include "overlapsearch.h"
+
+// The overlap chosen for each frame of an extraction: the match with the
+// frame before it, its error and whether it is iffy. An extraction keeps
+// one next to the sound file (<file>.overlap) and a later one can take
+// the overlaps from it instead of searching, so neither the profiles
+// (mode 4) nor the errors (mode 5) are computed again.
+//
+// The errors are all of one kind, OVERLAP_ERROR_SQUARED or
+// OVERLAP_ERROR_ABSOLUTE, which the file records.
+//
+// Bad frames are corrected by hand in <file>.overlap.txt, one frame per
+// line as "frame position", the position in samples of the search as
+// the log reports it; lines starting with # are comments.
+class OverlapMap
+{
+public:
+	typedef struct {
+		OverlapMatch match; // value is the error of the match, -1 if unknown
+		bool found;
+		bool iffy;
+		bool edited; // corrected by hand
+	} Entry;
+
+	OverlapMap();
+
+	// frames count from the source's first frame; positions are in n
+	// samples per frame
+	void Reset(long numFrames, int n, int metric = OVERLAP_ERROR_SQUARED);
+	long NumFrames() const { return long(entries.size()); }
+	int SamplesPerFrame() const { return samplesPerFrame; }
+	int Metric() const { return metric; }
+	// errors are measured as metric from now on; those of the frames
+	// already there become unknown if they were measured otherwise
+	void SetMetric(int metric);
+
+	bool Has(long frame) const;
+	// the entry of frame with its position scaled to n samples per frame
+	Entry Get(long frame, int n) const;
+	void Set(long frame, const OverlapMatch &match, bool iffy);
+	// position in the map's samples per frame, 0 to SamplesPerFrame();
+	// false, and nothing changed, outside that or the frames
+	bool Correct(long frame, float position);
+	std::vector<long> IffyFrames() const;
+
+	bool Save(const QString &fn) const;
+	// false, and the map unchanged, unless fn is an intact map with the
+	// given number of frames
+	bool Load(const QString &fn, long frames);
+	// the number of corrections applied, -1 if fn cannot be read
+	int LoadCorrections(const QString &fn);
+
+	static QString FileFor(const QString &soundFile)
+		{ return soundFile + ".overlap"; }
+	static QString CorrectionsFor(const QString &soundFile)
+		{ return soundFile + ".overlap.txt"; }
+
+	// A match at the edge of the window it was searched in: the real
+	// overlap may lie outside the search. overlap[] as in Frame_Window.
+	static bool Iffy(const OverlapMatch &best, int n, const float *overlap,
+			bool calc);
+
+private:
+	std::vector<Entry> entries;
+	int samplesPerFrame;
+	int metric;
+};
+
+#endif // OVERLAPMAP_H
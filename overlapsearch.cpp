@@ -0,0 +1,415 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "overlapsearch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define PI 3.14159265358979323846
+
+static float SmoothStep(float edge0, float edge1, float x)
+{
+	if(edge1 <= edge0) return (x < edge0) ? 0.0f : 1.0f;
+	float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+	return t * t * (3.0f - 2.0f * t);
+}
+
+// the error e at index s with the positional weighting of the mode 5
+// shader, or the maximum error outside the window
+static float Weighted(float e, int s, int n, float pitch, float window)
+{
+	float pos = 1.0f - float(s)/n;
+	float weighted = e;
+
+	if(pos > pitch+window || pos < pitch-window)
+		return 1.0f;
+
+	if(pos >= pitch-window && pos <= pitch)
+		weighted *= 1.0f + 0.5f*(1.0f - SmoothStep(pitch-window, pitch, pos));
+	if(pos <= pitch+window && pos >= pitch)
+		weighted *= 1.0f + 0.5f*SmoothStep(pitch, pitch+window, pos);
+
+	return 0.5f*(e + weighted);
+}
+
+OverlapSearch::OverlapSearch()
+{
+	nSamples = 0;
+	fftSize = 0;
+	for(int i=0; i<4; ++i) tracked[i] = 0;
+}
+
+void OverlapSearch::Resize(int n)
+{
+	if(n == nSamples) return;
+
+	nSamples = n;
+
+	// the previous profile is compared n/2 samples deep at every one of
+	// the n offsets; pad so the circular correlation never wraps around
+	fftSize = 1;
+	while(fftSize < n + n/2) fftSize <<= 1;
+
+	curSpectrum.resize(fftSize);
+	prevSpectrum.resize(fftSize);
+	prevEnergy.resize(n + n/2 + 1);
+
+	twiddle.resize(fftSize/2);
+	for(int i=0; i<fftSize/2; ++i)
+		twiddle[i] = std::polar(1.0, -2.0 * PI * i / fftSize);
+}
+
+// in-place iterative radix-2 FFT of fftSize points
+void OverlapSearch::FFT(std::complex<double> *data, bool inverse) const
+{
+	for(int i=1, j=0; i<fftSize; ++i)
+	{
+		int bit = fftSize >> 1;
+		for(; j & bit; bit >>= 1) j ^= bit;
+		j ^= bit;
+		if(i < j) std::swap(data[i], data[j]);
+	}
+
+	for(int len=2; len<=fftSize; len <<= 1)
+	{
+		int step = fftSize / len;
+		for(int i=0; i<fftSize; i+=len)
+		{
+			for(int k=0; k<len/2; ++k)
+			{
+				std::complex<double> w = twiddle[k*step];
+				if(inverse) w = std::conj(w);
+				std::complex<double> u = data[i+k];
+				std::complex<double> v = data[i+k+len/2] * w;
+				data[i+k] = u + v;
+				data[i+k+len/2] = u - v;
+			}
+		}
+	}
+
+	if(inverse)
+		for(int i=0; i<fftSize; ++i) data[i] /= fftSize;
+}
+
+void OverlapSearch::ComputeErrors(const float *cur, const float *prev, int n,
+		const float *overlap, float *err)
+{
+	Resize(n);
+
+	int depth = n/2; // compare the first half of the current frame
+	int ext = n + depth; // length of the clamped previous profile
+	double curEnergy = 0;
+	int s, k;
+
+	std::fill(curSpectrum.begin(), curSpectrum.end(), 0.0);
+	std::fill(prevSpectrum.begin(), prevSpectrum.end(), 0.0);
+
+	// as in mode 5, sample 0 is skipped
+	for(k=1; k<depth; ++k)
+	{
+		curSpectrum[k] = cur[k];
+		curEnergy += double(cur[k]) * cur[k];
+	}
+
+	// past the end the previous profile is clamped to its last sample,
+	// like the texture lookup in the shader
+	prevEnergy[0] = 0;
+	for(k=0; k<ext; ++k)
+	{
+		double v = prev[std::min(k, n-1)];
+		prevSpectrum[k] = v;
+		prevEnergy[k+1] = prevEnergy[k] + v*v;
+	}
+
+	FFT(&curSpectrum[0], false);
+	FFT(&prevSpectrum[0], false);
+	for(k=0; k<fftSize; ++k)
+		prevSpectrum[k] *= std::conj(curSpectrum[k]);
+	FFT(&prevSpectrum[0], true);
+
+	// sum((c-p)^2) = sum(c^2) + sum(p^2) - 2 sum(c*p): the cross term is
+	// the correlation, the energy of the shifted window a prefix sum.
+	// The mean squared difference has a parabolic valley around the
+	// match, which is what RefineMinimum() fits.
+	float pitch = overlap[2] + overlap[3];
+	float window = overlap[1];
+
+	for(s=0; s<n; ++s)
+	{
+		double sq = curEnergy + (prevEnergy[s+depth] - prevEnergy[s+1]) -
+				2.0 * prevSpectrum[s].real();
+		err[s] = Weighted(float(std::max(sq, 0.0) / (depth-1)), s, n,
+				pitch, window);
+	}
+}
+
+// The same errors summed directly, for a few positions: cheaper than the
+// transforms once the range is narrow.
+void OverlapSearch::ComputeErrors(const float *cur, const float *prev, int n,
+		const float *overlap, float *err, int lo, int hi) const
+{
+	int depth = n/2;
+	float pitch = overlap[2] + overlap[3];
+	float window = overlap[1];
+
+	std::fill(err, err + n, 1.0f);
+
+	for(int p=std::max(lo, 1); p<=std::min(hi, n); ++p)
+	{
+		int s = n - p; // positions count down as the index goes up
+		double sq = 0;
+
+		for(int k=1; k<depth; ++k)
+		{
+			double d = double(cur[k]) - prev[std::min(k+s, n-1)];
+			sq += d*d;
+		}
+
+		err[s] = Weighted(float(sq / (depth-1)), s, n, pitch, window);
+	}
+}
+
+// smallest error among positions lo+1..hi, the highest of equal ones, as
+// GetBestMatchFromFloatArray() finds it; err[n-p] holds position p
+void OverlapSearch::Minimum(const float *err, int n, int lo, int hi,
+		OverlapMatch &match)
+{
+	for(int p=hi; p>lo; --p)
+	{
+		if(p==hi || err[n-p] < match.value)
+		{
+			match.postion = p;
+			match.value = err[n-p];
+		}
+	}
+	match.subsample = 0;
+}
+
+void OverlapSearch::SearchWindows(int n, const float *overlap, int *lo,
+		int *hi)
+{
+	int start = (overlap[2]+overlap[3]) * n - (overlap[1]*0.5*n);
+	int end = (overlap[2]+overlap[3]) * n + (overlap[1]*0.5*n);
+
+	start = std::max(4,start);
+	end = std::min(end,n-2);
+	end = std::max(end,start);
+
+	lo[0] = start;
+	hi[0] = end;
+
+	int s_size = end-start;
+	int s_mid = start + (s_size/2);
+	int s_i_size = (s_size/2)/5;
+
+	for(int i=1; i<OVERLAP_WINDOWS; ++i)
+	{
+		if(i==1)
+		{
+			lo[i] = s_mid - 4;
+			hi[i] = s_mid + 4;
+		}
+		else
+		{
+			lo[i] = s_mid - s_i_size*i;
+			hi[i] = s_mid + s_i_size*i;
+		}
+
+		lo[i] = std::max(4,lo[i]);
+		hi[i] = std::min(hi[i],n-2);
+	}
+}
+
+void OverlapSearch::ResolveMatch(const OverlapMatch *found, const int *lo,
+		const int *hi, bool calc, OverlapMatch &best, OverlapMatch *windows)
+{
+	for(int i=1; i<OVERLAP_WINDOWS; ++i)
+		windows[i-1] = (hi[i] > lo[i]) ? found[i] : found[0];
+
+	best = calc ? windows[0] : windows[4];
+}
+
+void OverlapSearch::FindBestMatch(const float *err, int n,
+		const float *overlap, bool calc, OverlapMatch &best,
+		OverlapMatch *windows, int &start, int &end)
+{
+	int lo[OVERLAP_WINDOWS], hi[OVERLAP_WINDOWS];
+	OverlapMatch found[OVERLAP_WINDOWS];
+
+	SearchWindows(n, overlap, lo, hi);
+	start = lo[0];
+	end = hi[0];
+
+	for(int w=0; w<OVERLAP_WINDOWS; ++w)
+	{
+		if(w > 0 && hi[w] <= lo[w]) continue;
+
+		found[w].postion = hi[w];
+		found[w].value = err[n-hi[w]];
+		Minimum(err, n, lo[w], hi[w], found[w]);
+
+		// positions count down as the array index goes up
+		found[w].subsample = -RefineMinimum(err, n, n-found[w].postion);
+	}
+
+	ResolveMatch(found, lo, hi, calc, best, windows);
+}
+
+float OverlapSearch::RefineMinimum(const float *err, int n, int idx)
+{
+	if(idx < 1 || idx > n-2) return 0;
+
+	return RefineMinimum(err[idx-1], err[idx], err[idx+1]);
+}
+
+float OverlapSearch::RefineMinimum(float l, float c, float r)
+{
+	float curve = l - 2.0f*c + r;
+
+	// flat or not a minimum: keep the integer position
+	if(curve <= 0) return 0;
+
+	float offset = 0.5f * (l - r) / curve;
+
+	return std::min(std::max(offset, -0.5f), 0.5f);
+}
+
+void OverlapSearch::Search(const float *cur, const float *prev, int n,
+		const float *overlap, bool calc, bool track, float *err,
+		OverlapMatch &best, OverlapMatch *windows, int &start, int &end)
+{
+	track = track && !calc;
+
+	if(track)
+	{
+		// a history found with other settings predicts nothing
+		if(tracked[0] != n || tracked[1] != overlap[1] ||
+				tracked[2] != overlap[2] || tracked[3] != overlap[3])
+		{
+			tracker.Reset();
+			tracked[0] = n;
+			for(int i=1; i<4; ++i) tracked[i] = overlap[i];
+		}
+
+		// the window FindBestMatch() takes the match from
+		int lo[OVERLAP_WINDOWS], hi[OVERLAP_WINDOWS];
+		SearchWindows(n, overlap, lo, hi);
+		int w = (hi[OVERLAP_WINDOWS-1] > lo[OVERLAP_WINDOWS-1]) ?
+				OVERLAP_WINDOWS-1 : 0;
+
+		int tlo, thi;
+		if(tracker.Window(lo[w], hi[w], tlo, thi))
+		{
+			// one more position on each side for the refinement
+			ComputeErrors(cur, prev, n, overlap, err, tlo, thi+1);
+			Minimum(err, n, tlo, thi, best);
+			best.subsample = -RefineMinimum(err, n, n-best.postion);
+
+			if(tracker.Accept(best, tlo, thi, lo[w], hi[w]))
+			{
+				tracker.Add(best);
+				for(int i=0; i<OVERLAP_WINDOWS-1; ++i) windows[i] = best;
+				start = tlo;
+				end = thi;
+				return;
+			}
+		}
+	}
+
+	ComputeErrors(cur, prev, n, overlap, err);
+	FindBestMatch(err, n, overlap, calc, best, windows, start, end);
+	if(track) tracker.Add(best);
+}
+
+//-----------------------------------------------------------------------------
+// PitchTracker
+
+// least half width of a tracked window, in samples
+#define TRACK_MIN_HALF 6
+// half width in multiples of the scatter of the history about its line
+#define TRACK_SCATTER 4.0
+// an error this many times the median of the history is doubtful
+#define TRACK_ERROR_RISE 2.0f
+
+bool PitchTracker::Window(int fullLo, int fullHi, int &lo, int &hi) const
+{
+	if(count < TRACK_HISTORY) return false;
+
+	// least squares line through the history, oldest first
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	for(int i=0; i<TRACK_HISTORY; ++i)
+	{
+		double y = position[(next+i) % TRACK_HISTORY];
+		sx += i;
+		sy += y;
+		sxx += double(i)*i;
+		sxy += i*y;
+	}
+	double m = TRACK_HISTORY;
+	double slope = (m*sxy - sx*sy) / (m*sxx - sx*sx);
+	double base = (sy - slope*sx) / m;
+
+	double scatter = 0;
+	for(int i=0; i<TRACK_HISTORY; ++i)
+		scatter = std::max(scatter, std::fabs(
+				position[(next+i) % TRACK_HISTORY] - (base + slope*i)));
+
+	int half = std::max(TRACK_MIN_HALF,
+			int(std::ceil(TRACK_SCATTER*scatter)) + 2);
+	// not worth it below half the full window
+	if(4*half > fullHi - fullLo) return false;
+
+	int centre = int(std::floor(base + slope*TRACK_HISTORY + 0.5));
+	lo = std::max(fullLo, centre - half - 1);
+	hi = std::min(fullHi, centre + half);
+
+	return hi > lo + 2;
+}
+
+bool PitchTracker::Accept(const OverlapMatch &match, int lo, int hi,
+		int fullLo, int fullHi)
+{
+	// on an edge that is not the full window's, the minimum may be past it
+	bool edge = (lo > fullLo && match.postion <= lo+1) ||
+			(hi < fullHi && match.postion >= hi);
+
+	float sorted[TRACK_HISTORY];
+	std::copy(error, error + TRACK_HISTORY, sorted);
+	std::nth_element(sorted, sorted + TRACK_HISTORY/2,
+			sorted + TRACK_HISTORY);
+	float typical = std::max(sorted[TRACK_HISTORY/2], 1.0e-6f);
+
+	if(!edge && match.value <= TRACK_ERROR_RISE*typical) return true;
+
+	Reset();
+	return false;
+}
+
+void PitchTracker::Add(const OverlapMatch &match)
+{
+	position[next] = match.postion + match.subsample;
+	error[next] = match.value;
+	next = (next + 1) % TRACK_HISTORY;
+	if(count < TRACK_HISTORY) ++count;
+}
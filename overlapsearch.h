@@ -0,0 +1,157 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef OVERLAPSEARCH_H
+#define OVERLAPSEARCH_H
+
+#include <vector>
+#include <complex>
+
+typedef struct {
+	int postion;
+	float value;
+	float subsample; // parabolic refinement of postion
+} OverlapMatch;
+
+// what the value of a match measures
+#define OVERLAP_ERROR_SQUARED 0 // mean squared difference, OverlapSearch
+#define OVERLAP_ERROR_ABSOLUTE 1 // mean absolute difference, mode 5
+
+// the search window around the frame pitch and the five nested windows
+#define OVERLAP_WINDOWS 6
+
+// matches a tracked window is predicted from
+#define TRACK_HISTORY 8
+
+// Follows the overlap from frame to frame. On a stable print it hardly
+// moves, so once TRACK_HISTORY matches in a row lie close to a line, the
+// next one is looked for only where that line leads, a few times their
+// scatter either side, instead of in the whole search window.
+class PitchTracker
+{
+public:
+	PitchTracker() { Reset(); }
+
+	void Reset() { count = 0; next = 0; }
+
+	// The positions lo+1 .. hi to search, inside the full window
+	// fullLo+1 .. fullHi; false while the history is too short or too
+	// scattered for a narrower window to be worth it.
+	bool Window(int fullLo, int fullHi, int &lo, int &hi) const;
+	// A match from the narrowed window lo..hi is only trusted inside it,
+	// and with an error not well above the recent ones. Otherwise the
+	// history is dropped and the whole window has to be searched.
+	bool Accept(const OverlapMatch &match, int lo, int hi, int fullLo,
+			int fullHi);
+	void Add(const OverlapMatch &match);
+
+private:
+	float position[TRACK_HISTORY]; // with the subsample, oldest at next
+	float error[TRACK_HISTORY];
+	int count;
+	int next;
+};
+
+// CPU overlap search. Given the 1d overlap profiles of the current and
+// previous frame (the two columns rendered by mode 4), computes the
+// error of every candidate offset with an FFT cross-correlation instead
+// of the O(n^2) sliding comparison done by the mode 5 shader. The error
+// is the mean squared difference rather than the shader's mean absolute
+// difference, since only squares separate into a correlation.
+//
+// The error array uses the same layout as the mode 5 readback: element r
+// is the error of the previous frame shifted by r/n, so a match at
+// position p (in samplesperframe units) is found at index n-p. The same
+// positional weighting around the frame pitch is applied and entries
+// outside the search window are set to the maximum error of 1.0.
+class OverlapSearch
+{
+public:
+	OverlapSearch();
+
+	// cur and prev hold n samples each. overlap[] is laid out as in
+	// Frame_Window: [1] search window, [2] frame pitch, [3] frame start.
+	void ComputeErrors(const float *cur, const float *prev, int n,
+			const float *overlap, float *err);
+
+	// Search the error array as Frame_Window always has: the best match
+	// in the window around the frame pitch, then in five nested windows
+	// growing from its centre. The first of these is used while
+	// calibrating, the widest otherwise. start and end receive the
+	// extent of the search in samples.
+	static void FindBestMatch(const float *err, int n, const float *overlap,
+			bool calc, OverlapMatch &best, OverlapMatch *windows,
+			int &start, int &end);
+
+	// The windows searched by FindBestMatch(). Window w covers positions
+	// lo[w]+1 .. hi[w] and is empty if hi[w] <= lo[w]; window 0 is never
+	// empty, it holds just hi[0] if the range collapses. The smallest
+	// error of a window is at the highest position (lowest index) on ties.
+	static void SearchWindows(int n, const float *overlap, int *lo, int *hi);
+
+	// The second half of FindBestMatch(), for a search that has found the
+	// minimum of each window elsewhere (e.g. on the GPU). found[w] holds
+	// the minimum of window w with its subsample refinement; entries for
+	// empty windows are ignored.
+	static void ResolveMatch(const OverlapMatch *found, const int *lo,
+			const int *hi, bool calc, OverlapMatch &best,
+			OverlapMatch *windows);
+
+	// Fractional index offset (-0.5 .. 0.5) of the true minimum around
+	// err[idx], from a parabola through the neighbouring samples.
+	static float RefineMinimum(const float *err, int n, int idx);
+	static float RefineMinimum(float left, float centre, float right);
+
+	// ComputeErrors() and FindBestMatch() in one. With track, the frame
+	// follows the last one tracked: the errors are only computed, by
+	// direct comparison, around where the last frames lead (the rest of
+	// err is 1.0) and every window holds that match. Without, the whole
+	// window is searched and the history is left alone. Calibration
+	// always searches the whole window.
+	void Search(const float *cur, const float *prev, int n,
+			const float *overlap, bool calc, bool track, float *err,
+			OverlapMatch &best, OverlapMatch *windows, int &start, int &end);
+	// forget the history, when the next frame does not follow
+	void ResetTracking() { tracker.Reset(); }
+
+private:
+	static void Minimum(const float *err, int n, int lo, int hi,
+			OverlapMatch &match);
+	void Resize(int n);
+	void FFT(std::complex<double> *data, bool inverse) const;
+	// the errors of positions lo .. hi only, without the FFT
+	void ComputeErrors(const float *cur, const float *prev, int n,
+			const float *overlap, float *err, int lo, int hi) const;
+
+	int nSamples;
+	int fftSize;
+	std::vector< std::complex<double> > curSpectrum;
+	std::vector< std::complex<double> > prevSpectrum;
+	std::vector< std::complex<double> > twiddle;
+	std::vector<double> prevEnergy; // prefix sums of prev^2
+
+	PitchTracker tracker;
+	float tracked[4]; // n and overlap[1..3] the history was found with
+};
+
+#endif // OVERLAPSEARCH_H
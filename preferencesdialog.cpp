@@ -22,6 +22,8 @@
 //-----------------------------------------------------------------------------
 #include "preferencesdialog.h"
 #include "ui_preferencesdialog.h"
+#include "framecache.h"
+#include "stagecache.h"
 
 #include <QFileDialog>
 #include <QStandardPaths>
@@ -54,6 +56,25 @@ preferencesdialog::preferencesdialog(QWidget *parent) :
     ui->importText->setText(settings->value("import", sysRead).toString());
     settings->endGroup();
 
+	settings->beginGroup("extraction");
+	ui->backendComboBox->setCurrentIndex(
+			settings->value("backend", "gl").toString() == "cpu" ? 1 : 0);
+	ui->fixedPointCheckBox->setChecked(
+			settings->value("fixed-point", false).toBool());
+	ui->lumaCheckBox->setChecked(
+			settings->value("luma-only", false).toBool());
+	ui->batchSpinBox->setValue(settings->value("batch-frames", 1).toInt());
+	ui->trackPitchCheckBox->setChecked(
+			settings->value("track-pitch", true).toBool());
+	QString search = settings->value("overlap-search", "fft").toString();
+	ui->overlapSearchComboBox->setCurrentIndex(
+			search == "gpu" ? 1 : search == "readback" ? 2 : 0);
+	settings->endGroup();
+	ui->cacheSpinBox->setValue(
+			settings->value("cache/frame-megabytes", 1024).toInt());
+	ui->stageCacheSpinBox->setValue(
+			settings->value("cache/stage-megabytes", 512).toInt());
+
 	ui->sourceText->setPlaceholderText(sysRead);
 	ui->projectText->setPlaceholderText(sysWrite);
     ui->exportText->setPlaceholderText(sysWrite);
@@ -208,6 +229,24 @@ void preferencesdialog::Save()
 	settings->setValue("copyright", ui->copyrightText->text());
 	settings->endGroup();
 
+	settings->beginGroup("extraction");
+	settings->setValue("backend",
+			ui->backendComboBox->currentIndex() == 1 ? "cpu" : "gl");
+	settings->setValue("fixed-point", ui->fixedPointCheckBox->isChecked());
+	settings->setValue("luma-only", ui->lumaCheckBox->isChecked());
+	settings->setValue("batch-frames", ui->batchSpinBox->value());
+	settings->setValue("track-pitch", ui->trackPitchCheckBox->isChecked());
+	const char *searches[] = { "fft", "gpu", "readback" };
+	settings->setValue("overlap-search",
+			searches[ui->overlapSearchComboBox->currentIndex()]);
+	settings->endGroup();
+
+	settings->setValue("cache/frame-megabytes", ui->cacheSpinBox->value());
+	FrameCache::Shared().SetLimit(size_t(ui->cacheSpinBox->value()) << 20);
+	settings->setValue("cache/stage-megabytes", ui->stageCacheSpinBox->value());
+	StageCache::Shared().SetLimit(
+			size_t(ui->stageCacheSpinBox->value()) << 20);
+
 	accept();
 	//done(Accepted);
 }
@@ -24,11 +24,13 @@
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <vector>
 #include <cmath>
 #include <errno.h>
 
 #include "DPX.h"
 #include "readframedpx.h"
+#include "lightness.h"
 #include "aeoexception.h"
 
 using namespace dpx;
@@ -162,9 +164,11 @@ double *ReadFrameDPX(const char *dpxfn, double *buf=NULL)
 }
 unsigned char* ReadFrameDPX_ImageData(const char *dpxfn, unsigned char *buf,
 		int &bufSize, int &width,int &height,bool &endian,
-		GLenum &pix_fmt,int &num_components)
+		GLenum &pix_fmt,int &num_components, bool luma)
 {
 	InStream img;
+	// room in a buffer passed in, 0 if not known
+	int capacity = buf ? bufSize : 0;
 
 	// keep this around, since all the frames will be the same size
 	static unsigned char *byteBuf;
@@ -246,14 +250,34 @@ unsigned char* ReadFrameDPX_ImageData(const char *dpxfn, unsigned char *buf,
 		doRawRead = false;
 	}
 
-	if(buf == NULL)
+	if(luma) bufSize = width * height * 2;
+
+	// a buffer without room for the image is left to the caller
+	if(buf == NULL || (capacity > 0 && capacity < bufSize))
 	{
 		buf = new unsigned char [bufSize];
 		if(buf == NULL)
 			throw AeoException("Out of Memory: DPX image buf");
 	}
+	else if(capacity > 0)
+		bufSize = capacity;
 
-	if(doRawRead)
+	if(doRawRead && luma)
+	{
+		// a scanline at a time; buf may be write-only GL memory
+		std::vector<unsigned char> line(size_t(width) * pixel_size);
+		uint16_t *lbuf = reinterpret_cast<uint16_t *>(buf);
+
+		dpx.fd->Seek( dpx.header.imageOffset,dpx.fd->kStart);
+		for(int y=0; y<height; ++y)
+		{
+			dpx.fd->Read(&line[0], line.size());
+			PixelLightness(&line[0], width, pix_fmt, num_components,
+					dpx.header.RequiresByteSwap(), lbuf + size_t(y)*width);
+		}
+		endian = false;
+	}
+	else if(doRawRead)
 	{
 		endian=dpx.header.RequiresByteSwap();
 
@@ -262,10 +286,24 @@ unsigned char* ReadFrameDPX_ImageData(const char *dpxfn, unsigned char *buf,
 	}
 	else
 	{
+		// other colour encodings only come whole from ReadImage(), so in
+		// luma mode they are reduced after
+		std::vector<uint16_t> colour;
+		unsigned char *image = buf;
+		if(luma && numChannels > 1)
+		{
+			colour.resize(size_t(width) * height * numChannels);
+			image = reinterpret_cast<unsigned char *>(&colour[0]);
+		}
+
 		if(!remainder)
 		{
-			if(!dpx.ReadImage(buf, kWord, dpx.header.ImageDescriptor(0)))
+			if(!dpx.ReadImage(image, kWord, dpx.header.ImageDescriptor(0)))
 				throw("This DPX encoding is not supported (e.g., RLE)");
+			if(image != buf)
+				PixelLightness(image, size_t(width) * height,
+						GL_UNSIGNED_SHORT, numChannels, false,
+						reinterpret_cast<uint16_t *>(buf));
 		}
 		else
 		{
@@ -277,15 +315,11 @@ unsigned char* ReadFrameDPX_ImageData(const char *dpxfn, unsigned char *buf,
 			// and unpack it manually.
 
 			int numWords = ceil(double(width*height)/3.0);
-			static uint32_t *wbuf(NULL);
-			if(wbuf == NULL)
-			{
-				// make a buffer to hold the 32-bit words
-				wbuf = new uint32_t[numWords];
-				if(wbuf == NULL)
-					throw AeoException("Out of Memory: DPX word buf");
-
-			}
+			// a buffer per call: frames are decoded on several threads at
+			// once, and need not all be the same size. The unpacking below
+			// steps one word in before it starts, so one more word.
+			std::vector<uint32_t> words(numWords + 1, 0);
+			uint32_t *wbuf = &words[0];
 
 			// read in the whole array of 32-bit words from the DPX file
 			dpx.fd->Seek(dpx.header.imageOffset, dpx.fd->kStart);
@@ -322,9 +356,10 @@ unsigned char* ReadFrameDPX_ImageData(const char *dpxfn, unsigned char *buf,
 				}
 				// unpack the 10-bit word and rescale it to 16 bits
 				// ubuf[i] = uint16_t(((*word) & 0x03FF) * scale);
-				// approximate this scaling with bit operations for speed:
-				ubuf[i] = *word & 0x03FF;
-				ubuf[i] = (ubuf[i] << 6) | (ubuf[i] >> 4);
+				// approximate this scaling with bit operations for speed
+				// (ubuf is only written: it may be write-only GL memory)
+				uint16_t v = *word & 0x03FF;
+				ubuf[i] = (v << 6) | (v >> 4);
 				// shift the 32-bit word down and update the packed count
 				(*word) >>= 10;
 				nSample--;
@@ -336,6 +371,12 @@ unsigned char* ReadFrameDPX_ImageData(const char *dpxfn, unsigned char *buf,
 
 	}
 
+	if(luma)
+	{
+		pix_fmt = GL_UNSIGNED_SHORT;
+		num_components = 1;
+	}
+
 	img.Close();
 
 	return buf;
@@ -28,7 +28,9 @@
 
 double *ReadFrameDPX(const char *dpxfn, double *buf);
 //boost::numeric::ublas::matrix<double> ReadFrameDPX(const char *dpxfn);
+// With luma the image comes back as one native 16-bit lightness channel,
+// reduced one scanline at a time as it is read.
 unsigned char *ReadFrameDPX_ImageData(const char *dpxfn, unsigned char *buf,
 		int &bufSize, int &width, int &height, bool &endian,
-		GLenum &pix_fmt, int &num_components);
+		GLenum &pix_fmt, int &num_components, bool luma = false);
 #endif
@@ -26,6 +26,9 @@
 #include <tiffio.h>
 #include <errno.h>
 
+#include <vector>
+
+#include "lightness.h"
 #include "aeoexception.h"
 
 double *ReadFrameTIFF(const char *fn, double *buf)
@@ -35,8 +38,8 @@ double *ReadFrameTIFF(const char *fn, double *buf)
 }
 
 unsigned char *ReadFrameTIFF_ImageData(const char *fn, unsigned char *buf,
-		int &width, int &height, bool &endian,
-		GLenum &pix_fmt, int &num_components)
+		int bufSize, int &width, int &height, bool &endian,
+		GLenum &pix_fmt, int &num_components, bool luma)
 {
 	TIFF* tif = TIFFOpen(fn, "r");
 
@@ -133,10 +136,14 @@ unsigned char *ReadFrameTIFF_ImageData(const char *fn, unsigned char *buf,
 		throw AeoException("Out of memory: TIFF scanline buffer.");
 	}
 
-	if(buf == NULL)
+	// a buffer without room for the image (bufSize 0: not known) is left
+	// to the caller
+	size_t bytes = size_t(imageWidth) * imageHeight * numChannels *
+			(bitDepth/8u);
+	if(luma) bytes = size_t(imageWidth) * imageHeight * 2;
+	if(buf == NULL || (bufSize > 0 && size_t(bufSize) < bytes))
 	{
-		buf = new unsigned char[
-				imageWidth * imageHeight * numChannels * (bitDepth/8u)];
+		buf = new unsigned char[bytes];
 		if(buf==NULL)
 		{
 			_TIFFfree(tbuf);
@@ -145,6 +152,13 @@ unsigned char *ReadFrameTIFF_ImageData(const char *fn, unsigned char *buf,
 		}
 	}
 
+	GLenum format = (bitDepth==8) ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT;
+	uint16_t *lbuf = reinterpret_cast<uint16_t *>(buf);
+	// separate planes only give a pixel once all are read, so in luma
+	// mode they are put together here first
+	std::vector<unsigned char> planes;
+	unsigned char *image = buf;
+
 	switch(planarConfig)
 	{
 	case PLANARCONFIG_CONTIG:
@@ -156,12 +170,24 @@ unsigned char *ReadFrameTIFF_ImageData(const char *fn, unsigned char *buf,
 				TIFFClose(tif);
 				throw AeoException("TIFF I/O Error.");
 			}
-			memcpy(buf+row*imageWidth*numChannels*(bitDepth/8u), tbuf,
-					imageWidth*numChannels*(bitDepth/8u));
+			if(luma)
+				PixelLightness(tbuf, imageWidth, format, numChannels, false,
+						lbuf + size_t(row)*imageWidth);
+			else
+				memcpy(buf+row*imageWidth*numChannels*(bitDepth/8u), tbuf,
+						imageWidth*numChannels*(bitDepth/8u));
 		}
 		break;
 	case PLANARCONFIG_SEPARATE:
-		uint16 s, col;
+		uint16 s;
+		uint32 col;
+
+		if(luma)
+		{
+			planes.resize(size_t(imageWidth) * imageHeight * numChannels *
+					(bitDepth/8u));
+			image = &planes[0];
+		}
 
 		for (s = 0; s < numChannels; s++)
 		{
@@ -175,11 +201,17 @@ unsigned char *ReadFrameTIFF_ImageData(const char *fn, unsigned char *buf,
 				}
 				for(col = 0; col < imageWidth; col++)
 				{
-					memcpy(buf+(bitDepth/8u)*(s+numChannels*(col+imageWidth)),
-							tbuf, (bitDepth/8u));
+					memcpy(image+(bitDepth/8u)*
+							(s+numChannels*(col+size_t(row)*imageWidth)),
+							static_cast<unsigned char *>(tbuf)+
+							col*(bitDepth/8u), (bitDepth/8u));
 				}
 			}
 		}
+
+		if(luma)
+			PixelLightness(image, size_t(imageWidth) * imageHeight, format,
+					numChannels, false, lbuf);
 		break;
 	default:
 		_TIFFfree(tbuf);
@@ -192,10 +224,8 @@ unsigned char *ReadFrameTIFF_ImageData(const char *fn, unsigned char *buf,
 
 	width = imageWidth;
 	height = imageHeight;
-	num_components = numChannels;
-
-	if(bitDepth==8) pix_fmt = GL_UNSIGNED_BYTE;
-	else pix_fmt = GL_UNSIGNED_SHORT;
+	num_components = luma ? 1 : numChannels;
+	pix_fmt = luma ? GL_UNSIGNED_SHORT : format;
 
 	endian = false; // libtiff automatically converts to native endianness
 
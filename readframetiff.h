@@ -27,8 +27,10 @@
 #include <QOpenGLTexture>
 
 double *ReadFrameTIFF(const char *fn, double *buf);
+// With luma the image comes back as one native 16-bit lightness channel,
+// reduced one scanline at a time as it is read.
 unsigned char *ReadFrameTIFF_ImageData(const char *fn, unsigned char *buf,
-		int &width, int &height, bool &endian,
-		GLenum &pix_fmt, int &num_components);
+		int bufSize, int &width, int &height, bool &endian,
+		GLenum &pix_fmt, int &num_components, bool luma = false);
 
 #endif // READFRAMETIFF_H
@@ -0,0 +1,138 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "samplestream.h"
+
+#include <algorithm>
+#include <cstring>
+
+SampleStream::SampleStream(long c, QObject *parent)
+	: QIODevice(parent)
+{
+	capacity = c;
+	ring.resize(2 * capacity);
+	readPos = 0;
+	count = 0;
+	finished = false;
+	underruns = 0;
+	starved = false;
+}
+
+long SampleStream::Write(const float *left, const float *right, long n)
+{
+	{
+		QMutexLocker locker(&lock);
+
+		n = std::min(n, capacity - count);
+		long pos = (readPos + count) % capacity;
+		for(long i=0; i<n; ++i)
+		{
+			ring[2*pos] = left[i];
+			ring[2*pos+1] = right[i];
+			if(++pos == capacity) pos = 0;
+		}
+		count += n;
+		starved = false;
+	}
+
+	if(n) emit readyRead();
+
+	return n;
+}
+
+long SampleStream::Space() const
+{
+	QMutexLocker locker(&lock);
+	return capacity - count;
+}
+
+long SampleStream::Buffered() const
+{
+	QMutexLocker locker(&lock);
+	return count;
+}
+
+void SampleStream::Finish()
+{
+	QMutexLocker locker(&lock);
+	finished = true;
+}
+
+bool SampleStream::Finished() const
+{
+	QMutexLocker locker(&lock);
+	return finished;
+}
+
+int SampleStream::Underruns() const
+{
+	QMutexLocker locker(&lock);
+	return underruns;
+}
+
+bool SampleStream::atEnd() const
+{
+	QMutexLocker locker(&lock);
+	return finished && count == 0;
+}
+
+qint64 SampleStream::bytesAvailable() const
+{
+	QMutexLocker locker(&lock);
+
+	// never run dry before the end; an underrun plays silence
+	qint64 samples = finished ? count : std::max(count, capacity / 8);
+	return samples * 2 * sizeof(float) + QIODevice::bytesAvailable();
+}
+
+qint64 SampleStream::readData(char *data, qint64 maxlen)
+{
+	QMutexLocker locker(&lock);
+
+	long want = long(maxlen / (2 * sizeof(float)));
+	long n = std::min(want, count);
+	float *out = reinterpret_cast<float *>(data);
+
+	for(long i=0; i<n; ++i)
+	{
+		out[2*i] = ring[2*readPos];
+		out[2*i+1] = ring[2*readPos+1];
+		if(++readPos == capacity) readPos = 0;
+	}
+	count -= n;
+
+	if(finished || n == want) return n * 2 * sizeof(float);
+
+	// the extraction has not kept up: fill with silence rather than let
+	// the sink stop, and count each run of it once
+	if(!starved) ++underruns;
+	starved = true;
+	std::memset(out + 2*n, 0, (want - n) * 2 * sizeof(float));
+
+	return want * 2 * sizeof(float);
+}
+
+qint64 SampleStream::writeData(const char *, qint64)
+{
+	return -1; // written with Write()
+}
@@ -0,0 +1,72 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef SAMPLESTREAM_H
+#define SAMPLESTREAM_H
+
+#include <vector>
+
+#include <QIODevice>
+#include <QMutex>
+
+// A ring buffer of stereo float samples for the audio output to pull from
+// while the preview is still being extracted. Write() only takes what
+// fits, so the extraction is paced by playback and the preview can run
+// for any length. When the extraction falls behind, silence is played
+// and counted as an underrun; after Finish() the stream ends once it has
+// been played out.
+class SampleStream : public QIODevice
+{
+	Q_OBJECT
+
+public:
+	SampleStream(long capacity, QObject *parent = 0);
+
+	// returns the number of samples taken
+	long Write(const float *left, const float *right, long n);
+	long Space() const; // samples that can be written
+	long Buffered() const; // samples not played yet
+	void Finish();
+	bool Finished() const;
+	int Underruns() const;
+
+	bool isSequential() const Q_DECL_OVERRIDE { return true; }
+	bool atEnd() const Q_DECL_OVERRIDE;
+	qint64 bytesAvailable() const Q_DECL_OVERRIDE;
+
+protected:
+	qint64 readData(char *data, qint64 maxlen) Q_DECL_OVERRIDE;
+	qint64 writeData(const char *data, qint64 len) Q_DECL_OVERRIDE;
+
+private:
+	mutable QMutex lock;
+	std::vector<float> ring; // interleaved left, right
+	long capacity; // in samples per channel
+	long readPos;
+	long count;
+	bool finished;
+	int underruns;
+	bool starved; // the last read came up short
+};
+
+#endif // SAMPLESTREAM_H
@@ -0,0 +1,213 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "stagecache.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QSettings>
+
+// FNV-1a, so that keys do not depend on the run
+class StageHash
+{
+public:
+	StageHash() { h = 14695981039346656037ULL; }
+
+	StageHash &Add(const void *data, size_t n)
+	{
+		const unsigned char *p = static_cast<const unsigned char *>(data);
+		for(size_t i=0; i<n; ++i)
+		{
+			h ^= p[i];
+			h *= 1099511628211ULL;
+		}
+		return *this;
+	}
+	template<typename T> StageHash &operator<<(const T &v)
+		{ return Add(&v, sizeof(v)); }
+
+	quint64 Value() const { return h; }
+
+private:
+	quint64 h;
+};
+
+StageCache::StageCache(size_t l)
+{
+	bytes = 0;
+	limit = l;
+	recordingKey = 0;
+}
+
+StageCache::~StageCache()
+{
+	Clear();
+}
+
+StageCache &StageCache::Shared()
+{
+	static StageCache *shared = NULL;
+	static QMutex create;
+
+	QMutexLocker locker(&create);
+	if(!shared)
+	{
+		QSettings settings;
+		int mb = settings.value("cache/stage-megabytes", 512).toInt();
+		shared = new StageCache(size_t(std::max(mb, 0)) << 20);
+	}
+
+	return *shared;
+}
+
+quint64 StageCache::RowsKey(const std::string &source,
+		const ExtractionParameters &p, bool fixedPoint,
+		const float *calMask, int calPoints)
+{
+	StageHash h;
+
+	h.Add(source.data(), source.size());
+	h << p.lift << p.gamma << p.gain << p.threshold << p.thresh << p.blur
+			<< p.negative << p.rot_angle << fixedPoint;
+	h << p.bounds[0] << p.bounds[1] << p.pixbounds[0] << p.pixbounds[1];
+
+	h << p.cal_enabled;
+	if(p.cal_enabled && calMask)
+		h.Add(calMask, sizeof(float) * 2 * calPoints);
+
+	return h.Value();
+}
+
+quint64 StageCache::RecordingKey(quint64 rowsKey,
+		const ExtractionParameters &p, const char *backend,
+		bool trackPitch, int samplesPerFrame, long firstFrame,
+		long numFrames)
+{
+	StageHash h;
+
+	h << rowsKey;
+	h.Add(backend, std::strlen(backend));
+	h << trackPitch;
+	h << p.stereo << p.is_calc << p.overlap_target;
+	h << p.bounds[2] << p.bounds[3];
+	h << p.overlap[0] << p.overlap[1] << p.overlap[2] << p.overlap[3];
+	h << samplesPerFrame << firstFrame << numFrames;
+
+	return h.Value();
+}
+
+bool StageCache::GetRows(quint64 key, long frame, CpuEngine::RowMeans &out)
+{
+	QMutexLocker locker(&lock);
+
+	std::map<Key, Order::iterator>::iterator found =
+			index.find(Key(key, frame));
+	if(found == index.end()) return false;
+
+	// now the most recently used
+	order.splice(order.begin(), order, found->second);
+	out = order.front().rows;
+
+	return true;
+}
+
+void StageCache::PutRows(quint64 key, long frame,
+		const CpuEngine::RowMeans &rows)
+{
+	QMutexLocker locker(&lock);
+
+	Key k(key, frame);
+	if(index.find(k) != index.end()) return;
+
+	Entry e;
+	e.key = k;
+	e.rows = rows;
+	e.bytes = sizeof(float) * (rows.sound.size() + rows.left.size() +
+			rows.right.size() + rows.pix.size());
+
+	order.push_front(e);
+	index[k] = order.begin();
+	bytes += e.bytes;
+
+	Trim();
+}
+
+bool StageCache::GetRecording(quint64 key, float **out, long n)
+{
+	QMutexLocker locker(&lock);
+
+	if(key != recordingKey || long(recording[0].size()) != n) return false;
+
+	std::copy(recording[0].begin(), recording[0].end(), out[0]);
+	std::copy(recording[1].begin(), recording[1].end(), out[1]);
+
+	return true;
+}
+
+void StageCache::PutRecording(quint64 key, float *const *samples, long n)
+{
+	QMutexLocker locker(&lock);
+
+	recording[0].clear();
+	recording[1].clear();
+	recordingKey = 0;
+
+	if(2 * sizeof(float) * size_t(n) > limit) return;
+
+	recording[0].assign(samples[0], samples[0] + n);
+	recording[1].assign(samples[1], samples[1] + n);
+	recordingKey = key;
+}
+
+void StageCache::SetLimit(size_t l)
+{
+	QMutexLocker locker(&lock);
+
+	limit = l;
+	Trim();
+}
+
+void StageCache::Clear()
+{
+	QMutexLocker locker(&lock);
+
+	order.clear();
+	index.clear();
+	bytes = 0;
+
+	recording[0].clear();
+	recording[1].clear();
+	recordingKey = 0;
+}
+
+void StageCache::Trim()
+{
+	while(bytes > limit && !order.empty())
+	{
+		Entry &e = order.back();
+		bytes -= e.bytes;
+		index.erase(e.key);
+		order.pop_back();
+	}
+}
@@ -0,0 +1,104 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef STAGECACHE_H
+#define STAGECACHE_H
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <QMutex>
+#include <QtGlobal>
+
+#include "extractionbackend.h"
+#include "cpuengine.h"
+
+// Outputs of the extraction stages kept for the next run. The stages
+// form a chain:
+//
+//   decode -> crop and adjust -> overlap -> audio -> DSP -> write
+//
+// Decoded frames are in the FrameCache. The row means of a frame (crop
+// and adjust) are kept under a RowsKey(), a hash of the source and the
+// parameters they depend on. The samples of a whole extraction before the
+// DSP (overlap and audio) are kept under a RecordingKey(), which adds the
+// rest of the parameters, the sampling and film rates and the range. A
+// change only invalidates the stages that depend on it: a new bit depth
+// reuses the recording, a new sampling rate or overlap setting the row
+// means. The DSP and write stages are cheap and always run.
+class StageCache
+{
+public:
+	StageCache(size_t limit);
+	~StageCache();
+
+	// the cache of the application, sized by the "cache/stage-megabytes"
+	// setting
+	static StageCache &Shared();
+
+	// source identifies the decoded images (FilmScan::CacheKey())
+	static quint64 RowsKey(const std::string &source,
+			const ExtractionParameters &params, bool fixedPoint,
+			const float *calMask, int calPoints);
+	static quint64 RecordingKey(quint64 rowsKey,
+			const ExtractionParameters &params, const char *backend,
+			bool trackPitch, int samplesPerFrame, long firstFrame,
+			long numFrames);
+
+	bool GetRows(quint64 key, long frame, CpuEngine::RowMeans &out);
+	void PutRows(quint64 key, long frame, const CpuEngine::RowMeans &rows);
+
+	// only the latest recording is kept
+	bool GetRecording(quint64 key, float **out, long n);
+	void PutRecording(quint64 key, float *const *samples, long n);
+
+	void SetLimit(size_t bytes);
+	size_t Limit() const { return limit; }
+	void Clear();
+
+private:
+	typedef std::pair<quint64, long> Key;
+	typedef struct {
+		Key key;
+		CpuEngine::RowMeans rows;
+		size_t bytes;
+	} Entry;
+	typedef std::list<Entry> Order; // most recently used first
+
+	void Trim(); // drop the least recently used down to the limit
+
+	QMutex lock;
+	Order order;
+	std::map<Key, Order::iterator> index;
+	size_t bytes;
+	size_t limit;
+
+	quint64 recordingKey;
+	std::vector<float> recording[2];
+};
+
+#endif // STAGECACHE_H
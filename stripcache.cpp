@@ -0,0 +1,330 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "stripcache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QStandardPaths>
+
+#include "aeoexception.h"
+
+#define STRIP_MAGIC "AEOSTRP1"
+#define STRIP_VERSION 1
+
+// the index is read and written in place in the mapping
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+		"strip index entries must be plain 64-bit words");
+
+StripCache::StripCache()
+{
+	map = NULL;
+	mapSize = 0;
+	header = NULL;
+	index = NULL;
+}
+
+StripCache::~StripCache()
+{
+	Close();
+}
+
+QString StripCache::FileFor(const std::string &source)
+{
+	QString dir = QStandardPaths::writableLocation(
+			QStandardPaths::CacheLocation) + "/strips";
+	QDir().mkpath(dir);
+
+	QByteArray hash = QCryptographicHash::hash(
+			QByteArray::fromStdString(source), QCryptographicHash::Sha1);
+
+	return dir + "/" + QString::fromLatin1(hash.toHex()) + ".strip";
+}
+
+size_t StripCache::StripBytes() const
+{
+	return size_t(header->x1 - header->x0) * header->height * 2;
+}
+
+uint64_t StripCache::FrameOffset(int64_t i) const
+{
+	return sizeof(StripHeader) + header->numFrames * sizeof(uint64_t) +
+			i * StripBytes();
+}
+
+bool StripCache::Map(QIODevice::OpenMode mode)
+{
+	if(!file.open(mode)) return false;
+	if(file.size() < qint64(sizeof(StripHeader)))
+	{
+		file.close();
+		return false;
+	}
+
+	map = file.map(0, file.size());
+	if(!map)
+	{
+		file.close();
+		return false;
+	}
+
+	mapSize = file.size();
+	header = reinterpret_cast<StripHeader *>(map);
+	index = reinterpret_cast<std::atomic<uint64_t> *>(
+			map + sizeof(StripHeader));
+	return true;
+}
+
+bool StripCache::Create(const QString &fn, const FilmScan &scan,
+		int x0, int x1)
+{
+	Close();
+
+	x0 = std::max(x0, 0);
+	x1 = std::min(x1, int(scan.Width()));
+	if(x1 <= x0 || scan.NumFrames() <= 0) return false;
+
+	qint64 stripBytes = qint64(x1 - x0) * scan.Height() * 2;
+	qint64 size = sizeof(StripHeader) + scan.NumFrames() *
+			(sizeof(uint64_t) + stripBytes);
+
+	// sized up front so the builders only ever write into the mapping;
+	// the index starts out zero, with no frames
+	file.setFileName(fn);
+	if(!file.open(QIODevice::ReadWrite | QIODevice::Truncate)) return false;
+	bool sized = file.resize(size);
+	file.close();
+	if(!sized || !Map(QIODevice::ReadWrite))
+	{
+		Close();
+		QFile::remove(fn);
+		return false;
+	}
+
+	header->version = STRIP_VERSION;
+	header->width = scan.Width();
+	header->height = scan.Height();
+	header->x0 = x0;
+	header->x1 = x1;
+	header->reserved = 0;
+	header->firstFrame = scan.FirstFrame();
+	header->numFrames = scan.NumFrames();
+	// written last: a file cut short before this is never opened
+	memcpy(header->magic, STRIP_MAGIC, sizeof(header->magic));
+
+	return true;
+}
+
+bool StripCache::Open(const QString &fn, const FilmScan &scan)
+{
+	Close();
+
+	file.setFileName(fn);
+	if(!file.exists()) return false;
+	if(!Map(QIODevice::ReadWrite) && !Map(QIODevice::ReadOnly)) return false;
+
+	bool valid =
+			!memcmp(header->magic, STRIP_MAGIC, sizeof(header->magic)) &&
+			header->version == STRIP_VERSION &&
+			header->width == scan.Width() &&
+			header->height == scan.Height() &&
+			header->firstFrame == scan.FirstFrame() &&
+			header->numFrames == scan.NumFrames() &&
+			header->x0 < header->x1 && header->x1 <= header->width &&
+			file.size() >= qint64(sizeof(StripHeader) + header->numFrames *
+					(sizeof(uint64_t) + StripBytes()));
+
+	if(!valid) Close();
+	return valid;
+}
+
+void StripCache::Close()
+{
+	if(map) file.unmap(map);
+	if(file.isOpen()) file.close();
+	map = NULL;
+	mapSize = 0;
+	header = NULL;
+	index = NULL;
+}
+
+int StripCache::Left() const
+{
+	return map ? int(header->x0) : 0;
+}
+
+int StripCache::Right() const
+{
+	return map ? int(header->x1) : 0;
+}
+
+long StripCache::Frames() const
+{
+	if(!map) return 0;
+
+	long n = 0;
+	for(int64_t i=0; i<header->numFrames; ++i)
+		if(index[i].load(std::memory_order_relaxed)) ++n;
+
+	return n;
+}
+
+bool StripCache::Has(long frameNum) const
+{
+	if(!map) return false;
+
+	int64_t i = frameNum - header->firstFrame;
+	if(i < 0 || i >= header->numFrames) return false;
+
+	return index[i].load(std::memory_order_acquire) != 0;
+}
+
+bool StripCache::Read(long frameNum, FrameTexture *frame) const
+{
+	if(!map) return false;
+
+	int64_t i = frameNum - header->firstFrame;
+	if(i < 0 || i >= header->numFrames) return false;
+
+	// the offset is either 0 or where Write() puts the frame; anything
+	// else is a damaged file, and the frame is read from the source
+	uint64_t offset = index[i].load(std::memory_order_acquire);
+	if(offset == 0 || offset != FrameOffset(i) ||
+			offset + StripBytes() > uint64_t(mapSize))
+		return false;
+
+	const uint16_t *strip = reinterpret_cast<const uint16_t *>(map + offset);
+	int w = header->width;
+	int h = header->height;
+	int x0 = header->x0;
+	int sw = header->x1 - header->x0;
+
+	frame->width = w;
+	frame->height = h;
+	if(frame->buf == NULL || (frame->bufSize > 0 && frame->bufSize < w*h*2))
+	{
+		frame->bufSize = w * h * 2;
+		frame->buf = new uint8_t [frame->bufSize];
+	}
+
+	// the columns outside the strip were never kept
+	uint16_t *out = reinterpret_cast<uint16_t *>(frame->buf);
+	for(int y=0; y<h; ++y, out += w, strip += sw)
+	{
+		std::fill(out, out + x0, uint16_t(0));
+		memcpy(out + x0, strip, sw * 2);
+		std::fill(out + x0 + sw, out + w, uint16_t(0));
+	}
+
+	frame->nComponents = 1;
+	frame->format = GL_UNSIGNED_SHORT;
+	frame->isNonNativeEndianess = false;
+
+	return true;
+}
+
+void StripCache::Write(long frameNum, const FrameTexture *frame)
+{
+	if(!map || !(file.openMode() & QIODevice::WriteOnly))
+		throw AeoException("Strip cache is not writable");
+
+	int64_t i = frameNum - header->firstFrame;
+	if(i < 0 || i >= header->numFrames)
+		throw AeoException(QString("Frame out of range: %1").arg(frameNum));
+
+	if(frame->nComponents != 1 || frame->format != GL_UNSIGNED_SHORT ||
+			frame->width != int(header->width) ||
+			frame->height != int(header->height))
+		throw AeoException(QString("Frame %1 is not a lightness image "
+				"of the source").arg(frameNum));
+
+	uint64_t offset = FrameOffset(i);
+	uint16_t *strip = reinterpret_cast<uint16_t *>(map + offset);
+	const uint16_t *in = reinterpret_cast<const uint16_t *>(frame->buf) +
+			header->x0;
+	int sw = header->x1 - header->x0;
+
+	for(uint32_t y=0; y<header->height; ++y, in += header->width, strip += sw)
+		memcpy(strip, in, sw * 2);
+
+	// the frame is there once its offset is
+	index[i].store(offset, std::memory_order_release);
+}
+
+StripBuilder::StripBuilder(const FilmScan &source, StripCache *s,
+		long f, long n, QAtomicInt *d, QObject *parent)
+	: QThread(parent)
+{
+	sourceName = source.GetFileName();
+	sourceFormat = source.GetFormat();
+	strip = s;
+	first = f;
+	num = n;
+	done = d;
+}
+
+StripBuilder::~StripBuilder()
+{
+	Cancel();
+	wait();
+}
+
+void StripBuilder::run()
+{
+	FilmScan scan;
+	FrameTexture *frame = NULL;
+
+	try
+	{
+		if(!scan.Source(sourceName, sourceFormat))
+			throw AeoException(QString("Cannot open %1").
+					arg(QString::fromStdString(sourceName)));
+		// no frame cache: every frame is read once and kept here
+		scan.SetLumaOnly(true);
+
+		long end = std::min(scan.FirstFrame() + first + num,
+				scan.LastFrame() + 1);
+		for(long n = scan.FirstFrame() + first;
+				n < end && !cancel.loadRelaxed(); ++n)
+		{
+			// a build that was cut short goes on where it stopped
+			if(!strip->Has(n))
+			{
+				frame = scan.GetFrameImage(n, frame);
+				strip->Write(n, frame);
+			}
+			done->fetchAndAddRelaxed(1);
+		}
+	}
+	catch(std::exception &e)
+	{
+		error = e.what();
+	}
+
+	delete frame;
+}
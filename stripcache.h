@@ -0,0 +1,135 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef STRIPCACHE_H
+#define STRIPCACHE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+#include <QFile>
+#include <QString>
+#include <QThread>
+#include <QAtomicInt>
+
+#include "FilmScan.h"
+
+// A local copy of the columns of a scan that the extraction reads: for
+// each frame, the soundtrack and picture columns plus a margin, as 16-bit
+// lightness. Scans on slow storage are read once to build it; from then
+// on frames come from the memory mapped file instead of the source.
+//
+// The file is a header, an index with the offset of each frame (0 while
+// a frame is missing) and the strips, rows top first:
+//
+//   StripHeader | uint64_t index[numFrames] | uint16_t strip[h][x1-x0] ...
+//
+// Read() returns whole frames as the lightness decode would, with the
+// columns outside the strip black, so nothing downstream changes. The
+// strip is only attached to a source while the bounds lie inside it; an
+// index entry other than where the frame belongs reads as missing.
+class StripCache
+{
+public:
+	StripCache();
+	~StripCache();
+
+	// where the strips of a source are kept
+	static QString FileFor(const std::string &source);
+
+	// create the file for scan, holding columns x0 to x1, with no frames
+	bool Create(const QString &fn, const FilmScan &scan, int x0, int x1);
+	// open an existing file; false if it does not belong to scan
+	bool Open(const QString &fn, const FilmScan &scan);
+	void Close();
+	bool IsOpen() const { return map != NULL; }
+
+	int Left() const;
+	int Right() const;
+	long Frames() const; // stored so far
+
+	// frame numbers are those of the source
+	bool Has(long frameNum) const;
+	bool Read(long frameNum, FrameTexture *frame) const;
+	// store the strip of a lightness frame; frames may be written from
+	// several threads at once
+	void Write(long frameNum, const FrameTexture *frame);
+
+private:
+	typedef struct {
+		char magic[8];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t x0;
+		uint32_t x1;
+		uint32_t reserved;
+		int64_t firstFrame;
+		int64_t numFrames;
+	} StripHeader;
+
+	bool Map(QIODevice::OpenMode mode);
+	size_t StripBytes() const;
+	uint64_t FrameOffset(int64_t i) const; // where frame i goes
+
+	QFile file;
+	uchar *map;
+	qint64 mapSize;
+	StripHeader *header;
+	// written by the builders while others read
+	std::atomic<uint64_t> *index;
+};
+
+// Fills a StripCache from its own copy of the source. Several run at
+// once, each on its own run of frames, so slow storage is read in
+// parallel and every frame only once; a video is decoded forward from
+// one seek rather than seeking for every frame.
+class StripBuilder : public QThread
+{
+	Q_OBJECT
+
+public:
+	// frames count from the source's first frame
+	StripBuilder(const FilmScan &source, StripCache *strip, long first,
+			long num, QAtomicInt *done, QObject *parent = 0);
+	~StripBuilder();
+
+	void Cancel() { cancel.storeRelaxed(1); }
+	QString Error() const { return error; }
+
+protected:
+	void run() Q_DECL_OVERRIDE;
+
+private:
+	std::string sourceName;
+	SourceFormat sourceFormat;
+	StripCache *strip;
+	long first;
+	long num;
+	QAtomicInt *done; // frames stored, by all builders
+	QAtomicInt cancel;
+	QString error;
+};
+
+#endif // STRIPCACHE_H
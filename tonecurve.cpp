@@ -0,0 +1,109 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#include "tonecurve.h"
+
+#include <algorithm>
+#include <cmath>
+
+ToneCurve::ToneCurve()
+{
+	valid = false;
+	negative = false;
+	lift = 0;
+	gamma = 1.0;
+	gain = 1.0;
+	thresh = false;
+	threshold = 0;
+	maxStep = 0;
+}
+
+bool ToneCurve::Update(bool neg, float l, float gm, float gn,
+		bool th, float thv)
+{
+	if(valid && neg==negative && l==lift && gm==gamma && gn==gain &&
+			th==thresh && (!th || thv==threshold))
+		return false;
+
+	negative = neg;
+	lift = l;
+	gamma = gm;
+	gain = gn;
+	thresh = th;
+	threshold = thv;
+
+	levels.resize(SIZE);
+	scurve.resize(SIZE);
+	curve.resize(SIZE);
+
+	float half = std::pow(0.5f, threshold);
+
+	for(int i=0; i<SIZE; ++i)
+	{
+		float x = float(i) / (SIZE-1);
+
+		// same order of operations as render mode 0
+		float v = negative ? 1.0f - x : x;
+		v += lift;
+		v = std::min(std::max(v, 0.0f), 1.0f);
+		v = std::pow(v, gamma);
+		v *= gain;
+		v = std::min(std::max(v, 0.0f), 1.0f);
+		levels[i] = v;
+
+		if(thresh)
+		{
+			float p = std::pow(x, threshold);
+			scurve[i] = p / (half + p);
+		}
+		else scurve[i] = x;
+	}
+
+	curve16.resize(SIZE);
+	maxStep = 0;
+
+	for(int i=0; i<SIZE; ++i)
+	{
+		curve[i] = Interpolate(scurve, levels[i]);
+		curve16[i] = uint16_t(curve[i]*65535.0f + 0.5f);
+		if(i) maxStep = std::max(maxStep, std::fabs(curve[i] - curve[i-1]));
+	}
+
+	valid = true;
+
+	return true;
+}
+
+float ToneCurve::Interpolate(const std::vector<float> &table, float v)
+{
+	float f = std::min(std::max(v, 0.0f), 1.0f) * (SIZE-1);
+	int i = std::min(int(f), SIZE-2);
+	float a = f - i;
+
+	return table[i] + (table[i+1] - table[i]) * a;
+}
+
+float ToneCurve::Lookup(float v) const
+{
+	return Interpolate(curve, v);
+}
@@ -0,0 +1,76 @@
+//-----------------------------------------------------------------------------
+// This file is part of AEO-Light
+//
+// Copyright (c) 2016-2025 University of South Carolina
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms of the GNU General Public License as published by the
+// Free Software Foundation; either version 2 of the License, or (at your
+// option) any later version.
+//
+// AEO-Light is distributed in the hope that it will be useful, but
+// WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+// or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+// for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+//
+// Funding for AEO-Light development was provided through a grant from the
+// National Endowment for the Humanities
+//-----------------------------------------------------------------------------
+
+#ifndef TONECURVE_H
+#define TONECURVE_H
+
+#include <vector>
+#include <stdint.h>
+
+// The per-pixel tone chain of render mode 0 (negative, lift, gamma, gain
+// and the S-curve threshold) tabulated over a 16-bit input range. The
+// tables are only rebuilt when one of the parameters changes, so the
+// pow() calls are paid once per change instead of per pixel.
+//
+// Saturation sits between the levels and the S-curve in the shader, so
+// both halves are kept as well as the complete curve.
+class ToneCurve
+{
+public:
+	static const int SIZE = 65536;
+
+	ToneCurve();
+
+	// returns true if the tables were rebuilt
+	bool Update(bool negative, float lift, float gamma, float gain,
+			bool thresh, float threshold);
+
+	// complete curve for a value in 0-1, interpolated between entries
+	float Lookup(float v) const;
+
+	// complete curve rounded to 16 bits, for the fixed point path
+	const uint16_t *Curve16() const { return &curve16[0]; }
+	// largest change of the complete curve between neighbouring entries
+	float MaxStep() const { return maxStep; }
+
+	const float *Curve() const { return &curve[0]; }
+	const float *Levels() const { return &levels[0]; }
+	const float *SCurve() const { return &scurve[0]; }
+
+private:
+	static float Interpolate(const std::vector<float> &table, float v);
+
+	bool valid;
+	bool negative;
+	float lift,gamma,gain;
+	bool thresh;
+	float threshold;
+
+	std::vector<float> levels; // negative, lift, gamma, gain
+	std::vector<float> scurve; // S-curve alone (identity when off)
+	std::vector<float> curve;  // levels followed by S-curve
+	std::vector<uint16_t> curve16;
+	float maxStep;
+};
+
+#endif // TONECURVE_H
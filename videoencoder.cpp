@@ -71,16 +71,18 @@ static void log_packet(const AVFormatContext *fmt_ctx, const AVPacket *pkt)
 FrameTexture::FrameTexture()
 {
 	buf = NULL;
+	bufSize = 0;
 	width = 0;
 	height = 0;
 	format = GL_UNSIGNED_INT_10_10_10_2;
 	nComponents = 0;
 	isNonNativeEndianess = false;
+	borrowed = false;
 }
 
 FrameTexture::~FrameTexture()
 {
-	if(buf) delete [] buf;
+	if(buf && !borrowed) delete [] buf;
 }
 
 AudioFromTexture::AudioFromTexture(int _nChannels, int _rate, int _nSamples)
@@ -48,13 +48,15 @@ public:
 
 public:
 	uint8_t *buf;
-	int bufSize;
+	int bufSize; // bytes buf has room for; 0 if not known
 	int width;
 	int height;
 	GLenum format;
 	int nComponents;
 	bool isNonNativeEndianess;
-
+	// buf belongs to someone else (mapped GL memory): never deleted, and
+	// a decoder that needs more than bufSize leaves it alone
+	bool borrowed;
 };
 
 class AudioFromTexture